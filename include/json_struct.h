@@ -118,8 +118,12 @@
 #include <cmath>
 #include <cstring>
 #include <functional>
+#include <limits>
+#include <map>
 #include <memory>
+#include <set>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string>
 #include <vector>
@@ -133,6 +137,7 @@
 #endif
 #ifdef JS_STD_UNORDERED_MAP
 #include <unordered_map>
+#include <unordered_set>
 #endif
 
 #ifndef JS_STD_OPTIONAL
@@ -256,6 +261,91 @@ struct Token
   Type value_type;
 };
 
+/*!
+ *  \brief Token stored as offsets into the json data
+ *
+ *  A CompactToken is 16 bytes where a Token is 40 bytes on 64 bit platforms.
+ *  The offsets are relative to the base pointer of the CompactTokens
+ *  container holding the token.
+ */
+struct CompactToken
+{
+  uint32_t name_offset;
+  uint32_t value_offset;
+  uint32_t value_size;
+  uint32_t name_size : 24;
+  uint32_t name_type : 4;
+  uint32_t value_type : 4;
+};
+
+/*!
+ *  \brief Container storing tokens as CompactToken
+ *
+ *  CompactTokens mirrors the read interface of std::vector<Token>, but
+ *  elements are returned by value. All the tokens have to point into the
+ *  same contiguous buffer, which can be at most 4GB in size, and names are
+ *  limited to 16MB. push_back returns false for tokens that can not be
+ *  represented.
+ */
+class CompactTokens
+{
+public:
+  class const_iterator
+  {
+  public:
+    const_iterator(const CompactTokens *tokens, size_t index)
+      : m_tokens(tokens)
+      , m_index(index)
+    {
+    }
+    Token operator*() const
+    {
+      return (*m_tokens)[m_index];
+    }
+    const_iterator &operator++()
+    {
+      m_index++;
+      return *this;
+    }
+    bool operator==(const const_iterator &other) const
+    {
+      return m_index == other.m_index;
+    }
+    bool operator!=(const const_iterator &other) const
+    {
+      return m_index != other.m_index;
+    }
+
+  private:
+    const CompactTokens *m_tokens;
+    size_t m_index;
+  };
+
+  CompactTokens();
+
+  bool push_back(const Token &token);
+
+  Token operator[](size_t index) const;
+  Token at(size_t index) const;
+  Token front() const;
+  Token back() const;
+
+  size_t size() const;
+  bool empty() const;
+  void clear();
+  void reserve(size_t size);
+
+  const_iterator begin() const;
+  const_iterator end() const;
+
+  const char *base() const;
+  const std::vector<CompactToken> &compactTokens() const;
+
+private:
+  const char *m_base;
+  std::vector<CompactToken> m_tokens;
+};
+
 namespace Internal
 {
 struct IntermediateToken
@@ -364,6 +454,7 @@ enum class Error : unsigned char
   UnassignedRequiredMember,
   NonContigiousMemory,
   ScopeHasEnded,
+  TooLarge,
   UnknownError,
   UserDefinedErrors
 };
@@ -556,14 +647,42 @@ inline void RefCounter<T>::dec()
     callbackContainer->dec(index);
 }
 
-class Tokenizer;
+/*!
+ * Policy for the default Tokenizer. Enables the runtime leniency options
+ * (allowAsciiType, allowNewLineAsTokenDelimiter, allowSuperfluousComma), the
+ * scope tracking used by pushScope/popScope and the value copying used by
+ * copyFromValue/copyIncludingValue.
+ */
+struct LenientTokenizerPolicy
+{
+  static constexpr const bool leniency_options = true;
+  static constexpr const bool scope_tracking = true;
+  static constexpr const bool value_copying = true;
+};
+
+/*!
+ * Policy for tokenizing strict JSON. All the optional bookkeeping and the
+ * branches for the leniency options are removed at compile time.
+ */
+struct StrictTokenizerPolicy
+{
+  static constexpr const bool leniency_options = false;
+  static constexpr const bool scope_tracking = false;
+  static constexpr const bool value_copying = false;
+};
+
+template <typename Policy>
+class BasicTokenizer;
+typedef BasicTokenizer<LenientTokenizerPolicy> Tokenizer;
+typedef BasicTokenizer<StrictTokenizerPolicy> StrictTokenizer;
 typedef RefCounter<void(const char *)> ReleaseCBRef;
 typedef RefCounter<void(Tokenizer &)> NeedMoreDataCBRef;
 
-class Tokenizer
+template <typename Policy>
+class BasicTokenizer
 {
 public:
-  Tokenizer();
+  BasicTokenizer();
 
   void allowAsciiType(bool allow);
   void allowNewLineAsTokenDelimiter(bool allow);
@@ -573,12 +692,17 @@ public:
   template <size_t N>
   void addData(const char (&data)[N]);
   void addData(const std::vector<Token> *parsedData);
+  void addData(const CompactTokens *parsedData);
   size_t registeredBuffers() const;
 
-  NeedMoreDataCBRef registerNeedMoreDataCallback(std::function<void(Tokenizer &)> callback);
+  RefCounter<void(BasicTokenizer &)> registerNeedMoreDataCallback(std::function<void(BasicTokenizer &)> callback);
   ReleaseCBRef registerReleaseCallback(std::function<void(const char *)> &callback);
   Error nextToken(Token &next_token);
   const char *currentPosition() const;
+  /* The text left in the current buffer after the last complete token, and skipping ahead in it. Lets a TypeHandler
+   * scan simple content itself; it has to leave the cursor in front of a token the tokenizer can continue with. */
+  DataRef remainingBufferData() const;
+  void skipBufferData(size_t size);
 
   void copyFromValue(const Token &token, std::string &to_buffer);
   void copyIncludingValue(const Token &token, std::string &to_buffer);
@@ -621,6 +745,8 @@ private:
   Error findTokenEnd(const DataRef &json_data, size_t *chars_ahead);
   void requestMoreData();
   void releaseFirstDataRef();
+  size_t parsedTokenCount() const;
+  Token parsedToken(size_t index) const;
   Error populateFromDataRef(DataRef &data, Type &type, const DataRef &json_data);
   static void populate_annonymous_token(const DataRef &data, Type type, Token &token);
   Error populateNextTokenFromDataRef(Token &next_token, const DataRef &json_data);
@@ -644,9 +770,10 @@ private:
   std::vector<Internal::ScopeCounter> scope_counter;
   std::vector<Type> container_stack;
   Internal::CallbackContainer<void(const char *)> release_callbacks;
-  Internal::CallbackContainer<void(Tokenizer &)> need_more_data_callbacks;
+  Internal::CallbackContainer<void(BasicTokenizer &)> need_more_data_callbacks;
   std::vector<std::pair<size_t, std::string *>> copy_buffers;
   const std::vector<Token> *parsed_data_vector;
+  const CompactTokens *parsed_compact_tokens;
   Internal::ErrorContext error_context;
 };
 
@@ -755,7 +882,136 @@ inline Token::Token()
 {
 }
 
-inline Tokenizer::Tokenizer()
+namespace Internal
+{
+static inline bool compactOffset(const char *base, const DataRef &ref, uint32_t &offset)
+{
+  if (ref.data < base || size_t(ref.data - base) + ref.size > std::numeric_limits<uint32_t>::max())
+    return false;
+  offset = uint32_t(ref.data - base);
+  return true;
+}
+
+// Packs token as offsets relative to base. Returns false when the token does not fit in a CompactToken.
+static inline bool packCompactToken(const char *base, const Token &token, CompactToken &compact)
+{
+  compact.name_offset = 0;
+  compact.name_size = 0;
+  if (token.name.size)
+  {
+    if (token.name.size >= (size_t(1) << 24) || !compactOffset(base, token.name, compact.name_offset))
+      return false;
+    compact.name_size = uint32_t(token.name.size);
+  }
+  if (!compactOffset(base, token.value, compact.value_offset))
+  {
+    if (token.value.size)
+      return false;
+    compact.value_offset = 0;
+  }
+  compact.value_size = uint32_t(token.value.size);
+  compact.name_type = uint32_t(token.name_type);
+  compact.value_type = uint32_t(token.value_type);
+  return true;
+}
+
+static inline Token unpackCompactToken(const char *base, const CompactToken &compact)
+{
+  Token token;
+  if (compact.name_size)
+    token.name = DataRef(base + compact.name_offset, compact.name_size);
+  token.value = DataRef(base + compact.value_offset, compact.value_size);
+  token.name_type = Type(compact.name_type);
+  token.value_type = Type(compact.value_type);
+  return token;
+}
+} // namespace Internal
+
+inline CompactTokens::CompactTokens()
+  : m_base(nullptr)
+{
+}
+
+inline bool CompactTokens::push_back(const Token &token)
+{
+  if (m_tokens.empty())
+  {
+    m_base = token.value.data;
+    if (token.name.size && token.name.data < m_base)
+      m_base = token.name.data;
+  }
+
+  CompactToken compact;
+  if (!Internal::packCompactToken(m_base, token, compact))
+    return false;
+  m_tokens.push_back(compact);
+  return true;
+}
+
+inline Token CompactTokens::operator[](size_t index) const
+{
+  return Internal::unpackCompactToken(m_base, m_tokens[index]);
+}
+
+inline Token CompactTokens::at(size_t index) const
+{
+  assert(index < m_tokens.size());
+  return (*this)[index];
+}
+
+inline Token CompactTokens::front() const
+{
+  return (*this)[0];
+}
+
+inline Token CompactTokens::back() const
+{
+  return (*this)[m_tokens.size() - 1];
+}
+
+inline size_t CompactTokens::size() const
+{
+  return m_tokens.size();
+}
+
+inline bool CompactTokens::empty() const
+{
+  return m_tokens.empty();
+}
+
+inline void CompactTokens::clear()
+{
+  m_tokens.clear();
+  m_base = nullptr;
+}
+
+inline void CompactTokens::reserve(size_t size)
+{
+  m_tokens.reserve(size);
+}
+
+inline CompactTokens::const_iterator CompactTokens::begin() const
+{
+  return const_iterator(this, 0);
+}
+
+inline CompactTokens::const_iterator CompactTokens::end() const
+{
+  return const_iterator(this, m_tokens.size());
+}
+
+inline const char *CompactTokens::base() const
+{
+  return m_base;
+}
+
+inline const std::vector<CompactToken> &CompactTokens::compactTokens() const
+{
+  return m_tokens;
+}
+
+template <typename Policy>
+inline BasicTokenizer<Policy>::BasicTokenizer()
   : is_escaped(false)
   , allow_ascii_properties(false)
   , allow_new_lines(false)
@@ -768,76 +1024,106 @@ inline Tokenizer::Tokenizer()
   , line_range_context(256)
   , range_context(38)
   , parsed_data_vector(nullptr)
+  , parsed_compact_tokens(nullptr)
 {
   container_stack.reserve(16);
 }
 
-inline void Tokenizer::allowAsciiType(bool allow)
+template <typename Policy>
+inline void BasicTokenizer<Policy>::allowAsciiType(bool allow)
 {
+  static_assert(Policy::leniency_options, "The tokenizer policy does not support leniency options");
   allow_ascii_properties = allow;
 }
 
-inline void Tokenizer::allowNewLineAsTokenDelimiter(bool allow)
+template <typename Policy>
+inline void BasicTokenizer<Policy>::allowNewLineAsTokenDelimiter(bool allow)
 {
+  static_assert(Policy::leniency_options, "The tokenizer policy does not support leniency options");
   allow_new_lines = allow;
 }
 
-inline void Tokenizer::allowSuperfluousComma(bool allow)
+template <typename Policy>
+inline void BasicTokenizer<Policy>::allowSuperfluousComma(bool allow)
 {
+  static_assert(Policy::leniency_options, "The tokenizer policy does not support leniency options");
   allow_superfluous_comma = allow;
 }
-inline void Tokenizer::addData(const char *data, size_t data_size)
+template <typename Policy>
+inline void BasicTokenizer<Policy>::addData(const char *data, size_t data_size)
 {
   data_list.push_back(DataRef(data, data_size));
 }
 
+template <typename Policy>
 template <size_t N>
-inline void Tokenizer::addData(const char (&data)[N])
+inline void BasicTokenizer<Policy>::addData(const char (&data)[N])
 {
   data_list.push_back(DataRef(data));
 }
 
-inline void Tokenizer::addData(const std::vector<Token> *parsedData)
+template <typename Policy>
+inline void BasicTokenizer<Policy>::addData(const std::vector<Token> *parsedData)
 {
-  assert(parsed_data_vector == 0);
+  assert(parsed_data_vector == 0 && parsed_compact_tokens == 0);
   parsed_data_vector = parsedData;
   cursor_index = 0;
 }
 
-inline size_t Tokenizer::registeredBuffers() const
+template <typename Policy>
+inline void BasicTokenizer<Policy>::addData(const CompactTokens *parsedData)
+{
+  assert(parsed_data_vector == 0 && parsed_compact_tokens == 0);
+  parsed_compact_tokens = parsedData;
+  cursor_index = 0;
+}
+
+template <typename Policy>
+inline size_t BasicTokenizer<Policy>::registeredBuffers() const
 {
   return data_list.size();
 }
 
-inline NeedMoreDataCBRef Tokenizer::registerNeedMoreDataCallback(std::function<void(Tokenizer &)> callback)
+template <typename Policy>
+inline RefCounter<void(BasicTokenizer<Policy> &)> BasicTokenizer<Policy>::registerNeedMoreDataCallback(
+  std::function<void(BasicTokenizer<Policy> &)> callback)
 {
   return need_more_data_callbacks.addCallback(callback);
 }
 
-inline ReleaseCBRef Tokenizer::registerReleaseCallback(std::function<void(const char *)> &callback)
+template <typename Policy>
+inline ReleaseCBRef BasicTokenizer<Policy>::registerReleaseCallback(std::function<void(const char *)> &callback)
 {
   return release_callbacks.addCallback(callback);
 }
 
-inline Error Tokenizer::nextToken(Token &next_token)
+template <typename Policy>
+inline Error BasicTokenizer<Policy>::nextToken(Token &next_token)
 {
-  assert(!scope_counter.size() ||
-         (scope_counter.back().type != JS::Type::ArrayEnd && scope_counter.back().type != JS::Type::ObjectEnd));
-  if (scope_counter.size() && scope_counter.back().depth == 0)
+  JS_IF_CONSTEXPR(Policy::scope_tracking)
   {
-    return Error::ScopeHasEnded;
+    assert(!scope_counter.size() ||
+           (scope_counter.back().type != JS::Type::ArrayEnd && scope_counter.back().type != JS::Type::ObjectEnd));
+    if (scope_counter.size() && scope_counter.back().depth == 0)
+    {
+      return Error::ScopeHasEnded;
+    }
   }
-  if (parsed_data_vector)
+  if (parsed_data_vector || parsed_compact_tokens)
   {
-    next_token = (*parsed_data_vector)[cursor_index];
+    next_token = parsedToken(cursor_index);
     cursor_index++;
-    if (cursor_index == parsed_data_vector->size())
+    if (cursor_index == parsedTokenCount())
     {
       cursor_index = 0;
       parsed_data_vector = nullptr;
+      parsed_compact_tokens = nullptr;
+    }
+    JS_IF_CONSTEXPR(Policy::scope_tracking)
+    {
+      if (scope_counter.size())
+        scope_counter.back().handleType(next_token.value_type);
     }
-    if (scope_counter.size())
-      scope_counter.back().handleType(next_token.value_type);
     return Error::NoError;
   }
   if (data_list.empty())
@@ -886,15 +1172,19 @@ inline Error Tokenizer::nextToken(Token &next_token)
       assert(container_stack.size() && container_stack.back() == JS::Type::ObjectStart);
       container_stack.pop_back();
     }
-    if (scope_counter.size())
-      scope_counter.back().handleType(next_token.value_type);
+    JS_IF_CONSTEXPR(Policy::scope_tracking)
+    {
+      if (scope_counter.size())
+        scope_counter.back().handleType(next_token.value_type);
+    }
   }
   return error;
 }
 
-inline const char *Tokenizer::currentPosition() const
+template <typename Policy>
+inline const char *BasicTokenizer<Policy>::currentPosition() const
 {
-  if (parsed_data_vector)
+  if (parsed_data_vector || parsed_compact_tokens)
     return reinterpret_cast<const char *>(cursor_index);
 
   if (data_list.empty())
@@ -903,6 +1193,22 @@ inline const char *Tokenizer::currentPosition() const
   return data_list.front().data + cursor_index;
 }
 
+template <typename Policy>
+inline DataRef BasicTokenizer<Policy>::remainingBufferData() const
+{
+  if (parsed_data_vector || parsed_compact_tokens || data_list.empty() || continue_after_need_more_data)
+    return DataRef();
+  const DataRef &front = data_list.front();
+  return DataRef(front.data + cursor_index, front.size - cursor_index);
+}
+
+template <typename Policy>
+inline void BasicTokenizer<Policy>::skipBufferData(size_t size)
+{
+  assert(!data_list.empty() && cursor_index + size <= data_list.front().size);
+  cursor_index += size;
+}
+
 static bool isValueInIntermediateToken(const Token &token, const Internal::IntermediateToken &intermediate)
 {
   if (intermediate.data.size())
@@ -911,8 +1217,10 @@ static bool isValueInIntermediateToken(const Token &token, const Internal::Inter
   return false;
 }
 
-inline void Tokenizer::copyFromValue(const Token &token, std::string &to_buffer)
+template <typename Policy>
+inline void BasicTokenizer<Policy>::copyFromValue(const Token &token, std::string &to_buffer)
 {
+  static_assert(Policy::value_copying, "The tokenizer policy does not support copying values");
   if (isValueInIntermediateToken(token, intermediate_token))
   {
     std::string data(token.value.data, token.value.size);
@@ -930,8 +1238,10 @@ inline void Tokenizer::copyFromValue(const Token &token, std::string &to_buffer)
   }
 }
 
-inline void Tokenizer::copyIncludingValue(const Token &, std::string &to_buffer)
+template <typename Policy>
+inline void BasicTokenizer<Policy>::copyIncludingValue(const Token &, std::string &to_buffer)
 {
+  static_assert(Policy::value_copying, "The tokenizer policy does not support copying values");
   auto it =
     std::find_if(copy_buffers.begin(), copy_buffers.end(),
                  [&to_buffer](const std::pair<size_t, std::string *> &pair) { return &to_buffer == pair.second; });
@@ -942,21 +1252,27 @@ inline void Tokenizer::copyIncludingValue(const Token &, std::string &to_buffer)
   copy_buffers.erase(it);
 }
 
-inline void Tokenizer::pushScope(JS::Type type)
+template <typename Policy>
+inline void BasicTokenizer<Policy>::pushScope(JS::Type type)
 {
+  static_assert(Policy::scope_tracking, "The tokenizer policy does not support scope tracking");
   scope_counter.push_back({type, 1});
   if (type != Type::ArrayStart && type != Type::ObjectStart)
     scope_counter.back().depth--;
 }
 
-inline void Tokenizer::popScope()
+template <typename Policy>
+inline void BasicTokenizer<Policy>::popScope()
 {
+  static_assert(Policy::scope_tracking, "The tokenizer policy does not support scope tracking");
   assert(scope_counter.size() && scope_counter.back().depth == 0);
   scope_counter.pop_back();
 }
 
-inline JS::Error Tokenizer::goToEndOfScope(JS::Token &token)
+template <typename Policy>
+inline JS::Error BasicTokenizer<Policy>::goToEndOfScope(JS::Token &token)
 {
+  static_assert(Policy::scope_tracking, "The tokenizer policy does not support scope tracking");
   JS::Error error = JS::Error::NoError;
   while (scope_counter.back().depth && error == JS::Error::NoError)
   {
@@ -992,11 +1308,13 @@ static const char *error_strings[] = {
   "UnassignedRequiredMember",
   "NonContigiousMemory",
   "ScopeHasEnded",
+  "TooLarge",
   "UnknownError",
 };
 }
 
-inline std::string Tokenizer::makeErrorString() const
+template <typename Policy>
+inline std::string BasicTokenizer<Policy>::makeErrorString() const
 {
   static_assert(sizeof(Internal::error_strings) / sizeof *Internal::error_strings == size_t(Error::UserDefinedErrors),
                 "Please add missing error message");
@@ -1021,26 +1339,30 @@ inline std::string Tokenizer::makeErrorString() const
   return retString;
 }
 
-inline void Tokenizer::setErrorContextConfig(size_t lineContext, size_t rangeContext)
+template <typename Policy>
+inline void BasicTokenizer<Policy>::setErrorContextConfig(size_t lineContext, size_t rangeContext)
 {
   line_context = lineContext;
   range_context = rangeContext;
 }
 
-inline void Tokenizer::resetForNewToken()
+template <typename Policy>
+inline void BasicTokenizer<Policy>::resetForNewToken()
 {
   intermediate_token.clear();
   resetForNewValue();
 }
 
-inline void Tokenizer::resetForNewValue()
+template <typename Policy>
+inline void BasicTokenizer<Policy>::resetForNewValue()
 {
   property_state = InPropertyState::NoStartFound;
   property_type = Type::Error;
   current_data_start = 0;
 }
 
-inline Error Tokenizer::findStringEnd(const DataRef &json_data, size_t *chars_ahead)
+template <typename Policy>
+inline Error BasicTokenizer<Policy>::findStringEnd(const DataRef &json_data, size_t *chars_ahead)
 {
   size_t end = cursor_index;
   while (end < json_data.size)
@@ -1084,7 +1406,8 @@ inline Error Tokenizer::findStringEnd(const DataRef &json_data, size_t *chars_ah
   return Error::NeedMoreData;
 }
 
-inline Error Tokenizer::findAsciiEnd(const DataRef &json_data, size_t *chars_ahead)
+template <typename Policy>
+inline Error BasicTokenizer<Policy>::findAsciiEnd(const DataRef &json_data, size_t *chars_ahead)
 {
   assert(property_type == Type::Ascii);
   size_t end = cursor_index;
@@ -1128,7 +1451,8 @@ inline Error Tokenizer::findAsciiEnd(const DataRef &json_data, size_t *chars_ahe
   return Error::NeedMoreData;
 }
 
-inline Error Tokenizer::findNumberEnd(const DataRef &json_data, size_t *chars_ahead)
+template <typename Policy>
+inline Error BasicTokenizer<Policy>::findNumberEnd(const DataRef &json_data, size_t *chars_ahead)
 {
   size_t end = cursor_index;
   while (end + 4 < json_data.size)
@@ -1163,7 +1487,8 @@ inline Error Tokenizer::findNumberEnd(const DataRef &json_data, size_t *chars_ah
   return Error::NeedMoreData;
 }
 
-inline Error Tokenizer::findStartOfNextValue(Type *type, const DataRef &json_data, size_t *chars_ahead)
+template <typename Policy>
+inline Error BasicTokenizer<Policy>::findStartOfNextValue(Type *type, const DataRef &json_data, size_t *chars_ahead)
 {
 
   assert(property_state == InPropertyState::NoStartFound);
@@ -1224,7 +1549,8 @@ inline Error Tokenizer::findStartOfNextValue(Type *type, const DataRef &json_dat
   return Error::NeedMoreData;
 }
 
-inline Error Tokenizer::findDelimiter(const DataRef &json_data, size_t *chars_ahead)
+template <typename Policy>
+inline Error BasicTokenizer<Policy>::findDelimiter(const DataRef &json_data, size_t *chars_ahead)
 {
   if (container_stack.empty())
     return Error::IllegalPropertyType;
@@ -1263,7 +1589,8 @@ inline Error Tokenizer::findDelimiter(const DataRef &json_data, size_t *chars_ah
   return Error::NeedMoreData;
 }
 
-inline Error Tokenizer::findTokenEnd(const DataRef &json_data, size_t *chars_ahead)
+template <typename Policy>
+inline Error BasicTokenizer<Policy>::findTokenEnd(const DataRef &json_data, size_t *chars_ahead)
 {
   if (container_stack.empty())
     return Error::NoError;
@@ -1283,7 +1610,7 @@ inline Error Tokenizer::findTokenEnd(const DataRef &json_data, size_t *chars_ahe
     }
     else if (c == '\n')
     {
-      if (allow_new_lines)
+      if (Policy::leniency_options && allow_new_lines)
       {
         *chars_ahead = end + 1 - cursor_index;
         return Error::NoError;
@@ -1302,23 +1629,28 @@ inline Error Tokenizer::findTokenEnd(const DataRef &json_data, size_t *chars_ahe
   return Error::NeedMoreData;
 }
 
-inline void Tokenizer::requestMoreData()
+template <typename Policy>
+inline void BasicTokenizer<Policy>::requestMoreData()
 {
   need_more_data_callbacks.invokeCallbacks(*this);
 }
 
-inline void Tokenizer::releaseFirstDataRef()
+template <typename Policy>
+inline void BasicTokenizer<Policy>::releaseFirstDataRef()
 {
   if (data_list.empty())
     return;
 
   const DataRef &json_data = data_list.front();
 
-  for (auto &copy_pair : copy_buffers)
+  JS_IF_CONSTEXPR(Policy::value_copying)
   {
-    std::string data(json_data.data + copy_pair.first, json_data.size - copy_pair.first);
-    *copy_pair.second += data;
-    copy_pair.first = 0;
+    for (auto &copy_pair : copy_buffers)
+    {
+      std::string data(json_data.data + copy_pair.first, json_data.size - copy_pair.first);
+      *copy_pair.second += data;
+      copy_pair.first = 0;
+    }
   }
 
   cursor_index = 0;
@@ -1329,7 +1661,27 @@ inline void Tokenizer::releaseFirstDataRef()
   release_callbacks.invokeCallbacks(data_to_release);
 }
 
-inline Error Tokenizer::populateFromDataRef(DataRef &data, Type &type, const DataRef &json_data)
+template <typename Policy>
+inline size_t BasicTokenizer<Policy>::parsedTokenCount() const
+{
+  if (parsed_data_vector)
+    return parsed_data_vector->size();
+  if (parsed_compact_tokens)
+    return parsed_compact_tokens->size();
+  return 0;
+}
+
+template <typename Policy>
+inline Token BasicTokenizer<Policy>::parsedToken(size_t index) const
+{
+  assert(index < parsedTokenCount());
+  if (parsed_data_vector)
+    return (*parsed_data_vector)[index];
+  return (*parsed_compact_tokens)[index];
+}
+
+template <typename Policy>
+inline Error BasicTokenizer<Policy>::populateFromDataRef(DataRef &data, Type &type, const DataRef &json_data)
 {
   size_t diff = 0;
   Error error = Error::NoError;
@@ -1397,7 +1749,8 @@ inline Error Tokenizer::populateFromDataRef(DataRef &data, Type &type, const Dat
   return Error::NoError;
 }
 
-inline void Tokenizer::populate_annonymous_token(const DataRef &data, Type type, Token &token)
+template <typename Policy>
+inline void BasicTokenizer<Policy>::populate_annonymous_token(const DataRef &data, Type type, Token &token)
 {
   token.name = DataRef();
   token.name_type = Type::Ascii;
@@ -1441,7 +1794,8 @@ inline size_t strnlen(const char *data, size_t size)
 
 } // namespace Internal
 
-inline Error Tokenizer::populateNextTokenFromDataRef(Token &next_token, const DataRef &json_data)
+template <typename Policy>
+inline Error BasicTokenizer<Policy>::populateNextTokenFromDataRef(Token &next_token, const DataRef &json_data)
 {
   Token tmp_token;
   while (cursor_index < json_data.size)
@@ -1488,7 +1842,7 @@ inline Error Tokenizer::populateNextTokenFromDataRef(Token &next_token, const Da
         {
         case Type::ObjectEnd:
         case Type::ArrayEnd:
-          if (expecting_prop_or_annonymous_data && !allow_superfluous_comma)
+          if (expecting_prop_or_annonymous_data && !(Policy::leniency_options && allow_superfluous_comma))
           {
             return Error::ExpectedDataToken;
           }
@@ -1540,7 +1894,7 @@ inline Error Tokenizer::populateNextTokenFromDataRef(Token &next_token, const Da
       {
         if (tmp_token.name_type != Type::String)
         {
-          if (!allow_ascii_properties || tmp_token.name_type != Type::Ascii)
+          if (!(Policy::leniency_options && allow_ascii_properties) || tmp_token.name_type != Type::Ascii)
           {
             return Error::IllegalPropertyName;
           }
@@ -1593,7 +1947,7 @@ inline Error Tokenizer::populateNextTokenFromDataRef(Token &next_token, const Da
       tmp_token.value = data;
       tmp_token.value_type = Internal::getType(type, tmp_token.value.data, tmp_token.value.size);
 
-      if (tmp_token.value_type == Type::Ascii && !allow_ascii_properties)
+      if (tmp_token.value_type == Type::Ascii && !(Policy::leniency_options && allow_ascii_properties))
         return Error::IllegalDataValue;
 
       if (type == Type::ObjectStart || type == Type::ArrayStart)
@@ -1629,21 +1983,21 @@ struct Lines
 };
 } // namespace Internal
 
-inline Error Tokenizer::updateErrorContext(Error error, const std::string &custom_message)
+template <typename Policy>
+inline Error BasicTokenizer<Policy>::updateErrorContext(Error error, const std::string &custom_message)
 {
   error_context.error = error;
   error_context.custom_message = custom_message;
-  if ((!parsed_data_vector || parsed_data_vector->empty()) && data_list.empty())
+  const size_t parsed_count = parsedTokenCount();
+  if (!parsed_count && data_list.empty())
     return error;
 
   const DataRef json_data =
-    parsed_data_vector && parsed_data_vector->size()
-      ? DataRef(parsed_data_vector->front().value.data,
-                size_t(parsed_data_vector->back().value.data - parsed_data_vector->front().value.data))
-      : data_list.front();
-  size_t real_cursor_index = parsed_data_vector && parsed_data_vector->size()
-                               ? size_t(parsed_data_vector->at(cursor_index).value.data - json_data.data)
-                               : cursor_index;
+    parsed_count ? DataRef(parsedToken(0).value.data,
+                           size_t(parsedToken(parsed_count - 1).value.data - parsedToken(0).value.data))
+                 : data_list.front();
+  size_t real_cursor_index =
+    parsed_count ? size_t(parsedToken(cursor_index).value.data - json_data.data) : cursor_index;
   const size_t stop_back = real_cursor_index - std::min(real_cursor_index, line_range_context);
   const size_t stop_forward = std::min(real_cursor_index + line_range_context, json_data.size);
   std::vector<Internal::Lines> lines;
@@ -1970,7 +2324,7 @@ static inline JS::Error reformat(const char *data, size_t size, std::string &out
                                  const SerializerOptions &options = SerializerOptions())
 {
   Token token;
-  Tokenizer tokenizer;
+  StrictTokenizer tokenizer;
   tokenizer.addData(data, size);
   Error error = Error::NoError;
 
@@ -2319,6 +2673,67 @@ struct SilentUniquePtr
   typedef bool IsOptionalType;
 };
 
+namespace Internal
+{
+template <typename T>
+struct MemoizedState
+{
+  MemoizedState(const T &value)
+    : value(value)
+    , json(nullptr)
+    , pretty_json(nullptr)
+  {
+  }
+  MemoizedState(T &&value)
+    : value(std::move(value))
+    , json(nullptr)
+    , pretty_json(nullptr)
+  {
+  }
+  ~MemoizedState()
+  {
+    delete json.load();
+    delete pretty_json.load();
+  }
+  const T value;
+  mutable std::atomic<const std::string *> json;        // Compact
+  mutable std::atomic<const std::string *> pretty_json; // Pretty, as written at depth 0
+};
+} // namespace Internal
+
+/*! \brief Holds an immutable value whose JSON is serialized once and then spliced verbatim into every output.
+ *
+ *  Copies share both the value and the cached JSON, so a large reference object embedded in many documents is only
+ *  serialized the first time any of them is written. Compact and pretty output are cached separately, and the pretty
+ *  JSON is indented to the depth it is written at. Assigning a new value starts a new cache.
+ */
+template <typename T>
+struct Memoized
+{
+  Memoized()
+    : state(std::make_shared<const Internal::MemoizedState<T>>(T()))
+  {
+  }
+  Memoized(const T &t)
+    : state(std::make_shared<const Internal::MemoizedState<T>>(t))
+  {
+  }
+  Memoized(T &&t)
+    : state(std::make_shared<const Internal::MemoizedState<T>>(std::move(t)))
+  {
+  }
+  Memoized<T> &operator=(const T &other)
+  {
+    state = std::make_shared<const Internal::MemoizedState<T>>(other);
+    return *this;
+  }
+  const T &operator()() const
+  {
+    return state->value;
+  }
+  std::shared_ptr<const Internal::MemoizedState<T>> state;
+};
+
 struct JsonObjectRef
 {
   DataRef ref;
@@ -2349,9 +2764,136 @@ struct JsonObjectOrArray
   std::string data;
 };
 
+/*! \brief Number token kept as text, written back exactly as it was parsed.
+ *
+ *  The number is only converted when parseTo is called, using the TypeHandler of the target type. RawNumberRef
+ *  points into the parsed buffer, RawNumber keeps a copy which for typical numbers fits in the small string buffer.
+ */
+struct RawNumberRef
+{
+  DataRef ref;
+
+  template <typename T>
+  Error parseTo(T &to_type) const;
+};
+
+struct RawNumber
+{
+  std::string data;
+
+  template <typename T>
+  Error parseTo(T &to_type) const;
+};
+
+/*! \brief Collects the members of a JSON object that do not match any member of the struct.
+ *
+ *  Add a member of this type to a JS_OBJ struct to keep unknown members when parsing it. The raw name and value text
+ *  of each unknown member is copied into \p data, and serializing the struct writes them back unchanged in place of
+ *  the UnknownMembers member. A JSON member that happens to have the name of the UnknownMembers member is collected as
+ *  an unknown member as well.
+ */
+struct UnknownMembers
+{
+  struct Member
+  {
+    size_t name_offset;
+    size_t name_size;
+    size_t value_offset;
+    size_t value_size;
+    Type name_type;
+    Type value_type;
+  };
+
+  size_t size() const
+  {
+    return members.size();
+  }
+  bool empty() const
+  {
+    return members.empty();
+  }
+  void clear()
+  {
+    data.clear();
+    members.clear();
+  }
+  DataRef name(size_t index) const
+  {
+    return DataRef(data.data() + members[index].name_offset, members[index].name_size);
+  }
+  DataRef value(size_t index) const
+  {
+    return DataRef(data.data() + members[index].value_offset, members[index].value_size);
+  }
+
+  std::string data;
+  std::vector<Member> members;
+  typedef bool IsOptionalType;
+};
+
+/*! \brief Defers parsing of an object or array member until it is first accessed.
+ *
+ *  During the parent parse only the bytes of the value are copied into \p json. The first call to operator() parses
+ *  them into \p data with a default ParseContext and the result of that parse is available through error(). As long
+ *  as the value is only read through the const operator() it is serialized by writing \p json back verbatim. Scalar
+ *  values are parsed immediately.
+ */
+template <typename T>
+struct Lazy
+{
+  Lazy()
+    : data()
+    , parsed(true)
+    , parse_error(Error::NoError)
+  {
+  }
+  Lazy(const T &t)
+    : data(t)
+    , parsed(true)
+    , parse_error(Error::NoError)
+  {
+  }
+  Lazy<T> &operator=(const T &other)
+  {
+    json.clear();
+    data = other;
+    parsed = true;
+    parse_error = Error::NoError;
+    return *this;
+  }
+
+  T &operator()()
+  {
+    parse();
+    json.clear();
+    return data;
+  }
+  const T &operator()() const
+  {
+    parse();
+    return data;
+  }
+  bool isParsed() const
+  {
+    return parsed;
+  }
+  Error error() const
+  {
+    parse();
+    return parse_error;
+  }
+
+  void parse() const;
+
+  std::string json;
+  mutable T data;
+  mutable bool parsed;
+  mutable Error parse_error;
+};
+
 struct JsonTokens
 {
-  std::vector<JS::Token> data;
+  CompactTokens data;
 };
 
 struct JsonMeta
@@ -2381,45 +2923,45 @@ static inline std::vector<JsonMeta> metaForTokens(const JsonTokens &tokens)
   std::vector<JsonMeta> meta;
   meta.reserve(tokens.data.size() / 4);
   std::vector<size_t> parent;
+  // Sizes and skips are resolved when a scope closes, and has_data is
+  // propagated to the enclosing scope, so each token is only visited once.
+  auto closeScope = [&meta, &parent](size_t last_position) {
+    JsonMeta &closing = meta[parent.back()];
+    closing.size = static_cast<unsigned int>(last_position - closing.position + 1);
+    closing.skip = static_cast<unsigned int>(meta.size() - parent.back());
+    parent.pop_back();
+    if (parent.size() && closing.has_data)
+      meta[parent.back()].has_data = true;
+  };
   for (size_t i = 0; i < tokens.data.size(); i++)
   {
-    for (size_t parent_index : parent)
-    {
-      meta[parent_index].size++;
-    }
     const JS::Token &token = tokens.data.at(i);
     if (token.value_type == Type::ArrayEnd || token.value_type == Type::ObjectEnd)
     {
       assert(parent.size());
       assert(meta[parent.back()].is_array == (token.value_type == Type::ArrayEnd));
-      parent.pop_back();
-    }
-    else
-    {
-      if (parent.size())
-        meta[parent.back()].children++;
+      closeScope(i);
+      continue;
     }
 
+    if (parent.size())
+      meta[parent.back()].children++;
+
     if (token.value_type == Type::ArrayStart || token.value_type == Type::ObjectStart)
     {
       if (parent.size())
         meta[parent.back()].complex_children++;
-      for (size_t parent_index : parent)
-      {
-        meta[parent_index].skip++;
-      }
       meta.push_back(JsonMeta(i, token.value_type == Type::ArrayStart));
       parent.push_back(meta.size() - 1);
     }
-    else if (token.value_type != JS::Type::ArrayEnd && token.value_type != JS::Type::ObjectEnd)
+    else if (parent.size())
     {
-      for (size_t parent_index : parent)
-      {
-        meta[parent_index].has_data = true;
-      }
+      meta[parent.back()].has_data = true;
     }
   }
   assert(!parent.size()); // This assert may be triggered when JSON is invalid (e.g. when creating a DiffContext).
+  while (parent.size())
+    closeScope(tokens.data.size() - 1);
   return meta;
 }
 
@@ -2474,6 +3016,14 @@ struct IsOptionalType<std::optional<T>>
 };
 #endif
 
+class ValueArena;
+
+/*!
+ * ParseContext always parses with the lenient Tokenizer. TypeHandler<T>::to takes a ParseContext &, and handlers
+ * rely on pushScope/goToEndOfScope and copyFromValue/copyIncludingValue which StrictTokenizer does not have, so
+ * templating the context on the tokenizer policy would change the signature every user TypeHandler is written
+ * against. Code that only needs tokens, like reformat and DiffTokens, uses StrictTokenizer directly.
+ */
 struct ParseContext
 {
   ParseContext()
@@ -2529,6 +3079,7 @@ struct ParseContext
   bool allow_missing_members = true;
   bool allow_unnasigned_required_members = true;
   bool track_member_assignement_state = true;
+  std::shared_ptr<ValueArena> value_arena; // Shared by the JS::Value instances parsed with this context
 };
 
 /*! \def JS_MEMBER
@@ -2873,6 +3424,13 @@ inline void serializeMember(const T &from_type, const MemberInfo<MI_T, MI_M, MI_
   TypeHandler<MI_T>::from(from_type.*memberInfo.member, token, serializer);
 }
 
+template <typename T, typename MI_T, typename MI_M, typename MI_NC, typename Visitor>
+inline void visitMember(const T &a, const T &b, const MemberInfo<MI_T, MI_M, MI_NC> &memberInfo, Visitor &visitor)
+{
+  visitor(a.*memberInfo.member, b.*memberInfo.member,
+          DataRef(memberInfo.names.template get<0>().data, memberInfo.names.template get<0>().size));
+}
+
 template <typename T, size_t PAGE, size_t INDEX>
 struct SuperClassHandler
 {
@@ -2881,6 +3439,8 @@ struct SuperClassHandler
                              std::vector<std::string> &missing_members);
   static constexpr size_t membersInSuperClasses();
   static void serializeMembers(const T &from_type, Token &token, Serializer &serializer);
+  template <typename Visitor>
+  static void visitMembers(const T &a, const T &b, Visitor &visitor);
 };
 
 template <typename T, size_t PAGE, size_t SIZE>
@@ -2907,6 +3467,12 @@ struct StartSuperRecursion
   {
     return SuperClassHandler<T, PAGE, SIZE - 1>::serializeMembers(from_type, token, serializer);
   }
+
+  template <typename Visitor>
+  static void visitMembers(const T &a, const T &b, Visitor &visitor)
+  {
+    SuperClassHandler<T, PAGE, SIZE - 1>::visitMembers(a, b, visitor);
+  }
 };
 
 template <typename T, size_t PAGE>
@@ -2949,6 +3515,14 @@ struct StartSuperRecursion<T, PAGE, 0>
     JS_UNUSED(token);
     JS_UNUSED(serializer);
   }
+
+  template <typename Visitor>
+  static void visitMembers(const T &a, const T &b, Visitor &visitor)
+  {
+    JS_UNUSED(a);
+    JS_UNUSED(b);
+    JS_UNUSED(visitor);
+  }
 };
 
 template <typename T, typename Members, size_t PAGE, size_t INDEX>
@@ -2983,6 +3557,13 @@ struct MemberChecker
     serializeMember(from_type, members.template get<Members::size - INDEX - 1>(), token, serializer, super_name);
     MemberChecker<T, Members, PAGE, INDEX - 1>::serializeMembers(from_type, members, token, serializer, super_name);
   }
+
+  template <typename Visitor>
+  inline static void visitMembers(const T &a, const T &b, const Members &members, Visitor &visitor)
+  {
+    visitMember(a, b, members.template get<Members::size - INDEX - 1>(), visitor);
+    MemberChecker<T, Members, PAGE, INDEX - 1>::visitMembers(a, b, members, visitor);
+  }
 };
 
 template <typename T, typename Members, size_t PAGE>
@@ -3020,6 +3601,14 @@ struct MemberChecker<T, Members, PAGE, 0>
     using Super = decltype(Internal::template JsonStructBaseDummy<T, T>::js_static_meta_super_info());
     StartSuperRecursion<T, PAGE + Members::size, Super::size>::serializeMembers(from_type, token, serializer);
   }
+
+  template <typename Visitor>
+  inline static void visitMembers(const T &a, const T &b, const Members &members, Visitor &visitor)
+  {
+    visitMember(a, b, members.template get<Members::size - 1>(), visitor);
+    using Super = decltype(Internal::template JsonStructBaseDummy<T, T>::js_static_meta_super_info());
+    StartSuperRecursion<T, PAGE + Members::size, Super::size>::visitMembers(a, b, visitor);
+  }
 };
 
 template <typename T, size_t PAGE, size_t INDEX>
@@ -3077,6 +3666,18 @@ void SuperClassHandler<T, PAGE, INDEX>::serializeMembers(const T &from_type, Tok
   SuperClassHandler<T, PAGE + memberCount<Super, 0>(), INDEX - 1>::serializeMembers(from_type, token, serializer);
 }
 
+template <typename T, size_t PAGE, size_t INDEX>
+template <typename Visitor>
+void SuperClassHandler<T, PAGE, INDEX>::visitMembers(const T &a, const T &b, Visitor &visitor)
+{
+  using SuperMeta = decltype(Internal::template JsonStructBaseDummy<T, T>::js_static_meta_super_info());
+  using Super = typename TypeAt<INDEX, SuperMeta>::type::type;
+  using Members = decltype(Internal::template JsonStructBaseDummy<Super, Super>::js_static_meta_data_info());
+  auto members = Internal::template JsonStructBaseDummy<Super, Super>::js_static_meta_data_info();
+  MemberChecker<Super, Members, PAGE, Members::size - 1>::visitMembers(a, b, members, visitor);
+  SuperClassHandler<T, PAGE + memberCount<Super, 0>(), INDEX - 1>::visitMembers(a, b, visitor);
+}
+
 template <typename T, size_t PAGE>
 struct SuperClassHandler<T, PAGE, 0>
 {
@@ -3115,8 +3716,25 @@ struct SuperClassHandler<T, PAGE, 0>
     auto members = Internal::JsonStructBaseDummy<Super, Super>::js_static_meta_data_info();
     MemberChecker<Super, Members, PAGE, Members::size - 1>::serializeMembers(from_type, members, token, serializer, "");
   }
+  template <typename Visitor>
+  static void visitMembers(const T &a, const T &b, Visitor &visitor)
+  {
+    using SuperMeta = decltype(Internal::template JsonStructBaseDummy<T, T>::js_static_meta_super_info());
+    using Super = typename TypeAt<0, SuperMeta>::type::type;
+    using Members = decltype(Internal::template JsonStructBaseDummy<Super, Super>::js_static_meta_data_info());
+    auto members = Internal::JsonStructBaseDummy<Super, Super>::js_static_meta_data_info();
+    MemberChecker<Super, Members, PAGE, Members::size - 1>::visitMembers(a, b, members, visitor);
+  }
 };
 
+template <typename T, typename Visitor>
+void visitStructMembers(const T &a, const T &b, Visitor &visitor)
+{
+  using Members = decltype(Internal::template JsonStructBaseDummy<T, T>::js_static_meta_data_info());
+  auto members = Internal::template JsonStructBaseDummy<T, T>::js_static_meta_data_info();
+  MemberChecker<T, Members, 0, Members::size - 1>::visitMembers(a, b, members, visitor);
+}
+
 static bool skipArrayOrObject(ParseContext &context)
 {
   assert(context.error == Error::NoError);
@@ -4172,6 +4790,71 @@ void populateEnumNames(std::vector<DataRef> &names, const char (&data)[N])
 
 namespace JS
 {
+namespace Internal
+{
+inline Error appendUnknownMember(UnknownMembers &unknown, ParseContext &context);
+
+template <typename Members, size_t INDEX, bool = (INDEX < Members::size)>
+struct UnknownMembersIndex
+{
+  using Member = typename TypeAt<INDEX, Members>::type;
+  static constexpr const size_t value = std::is_same<typename Member::type, UnknownMembers>::value
+                                          ? INDEX
+                                          : UnknownMembersIndex<Members, INDEX + 1>::value;
+};
+
+template <typename Members, size_t INDEX>
+struct UnknownMembersIndex<Members, INDEX, false>
+{
+  static constexpr const size_t value = Members::size;
+};
+
+template <typename T, typename Members = decltype(JsonStructBaseDummy<T, T>::js_static_meta_data_info()),
+          size_t INDEX = UnknownMembersIndex<Members, 0>::value, bool = (INDEX < Members::size)>
+struct UnknownMembersHandler
+{
+  static UnknownMembers &get(T &to_type)
+  {
+    return to_type.*(JsonStructBaseDummy<T, T>::js_static_meta_data_info().template get<INDEX>().member);
+  }
+  static void clear(T &to_type)
+  {
+    get(to_type).clear();
+  }
+  static Error collect(T &to_type, ParseContext &context)
+  {
+    return appendUnknownMember(get(to_type), context);
+  }
+};
+
+template <typename T, typename Members, size_t INDEX>
+struct UnknownMembersHandler<T, Members, INDEX, false>
+{
+  static void clear(T &to_type)
+  {
+    JS_UNUSED(to_type);
+  }
+  static Error collect(T &to_type, ParseContext &context)
+  {
+    JS_UNUSED(to_type);
+    JS_UNUSED(context);
+    return Error::MissingPropertyMember;
+  }
+};
+
+template <typename T>
+inline void clearUnknownMembers(T &to_type)
+{
+  UnknownMembersHandler<T>::clear(to_type);
+}
+
+template <typename T>
+inline Error collectUnknownMember(T &to_type, ParseContext &context)
+{
+  return UnknownMembersHandler<T>::collect(to_type, context);
+}
+} // namespace Internal
+
 template <typename T>
 inline Error TypeHandler<T>::to(T &to_type, ParseContext &context)
 {
@@ -4184,6 +4867,7 @@ inline Error TypeHandler<T>::to(T &to_type, ParseContext &context)
   using MembersType = decltype(members);
   bool assigned_members[Internal::memberCount<T, 0>()];
   memset(assigned_members, 0, sizeof(assigned_members));
+  Internal::clearUnknownMembers(to_type);
   while (context.token.value_type != JS::Type::ObjectEnd)
 
   {
@@ -4193,6 +4877,8 @@ inline Error TypeHandler<T>::to(T &to_type, ParseContext &context)
     if (error == Error::MissingPropertyMember)
       error = Internal::MemberChecker<T, MembersType, 0, MembersType::size - 1>::unpackMembers(
         to_type, members, context, false, assigned_members);
+    if (error == Error::MissingPropertyMember)
+      error = Internal::collectUnknownMember(to_type, context);
     if (error == Error::MissingPropertyMember)
     {
 
@@ -4399,22 +5085,22 @@ static void handle_json_escapes_in(const DataRef &ref, std::string &to_type)
   }
 }
 
-static DataRef handle_json_escapes_out(const std::string &data, std::string &buffer)
+static DataRef handle_json_escapes_out(const char *data, size_t size, std::string &buffer)
 {
   int start_index = 0;
-  for (size_t i = 0; i < data.size(); i++)
+  for (size_t i = 0; i < size; i++)
   {
     const char cur = data[i];
     if (static_cast<uint8_t>(cur) <= uint8_t('\r') || cur == '\"' || cur == '\\')
     {
       if (buffer.empty())
       {
-        buffer.reserve(data.size() + 10);
+        buffer.reserve(size + 10);
       }
       size_t diff = i - start_index;
       if (diff > 0)
       {
-        buffer.insert(buffer.end(), data.data() + start_index, data.data() + start_index + diff);
+        buffer.insert(buffer.end(), data + start_index, data + start_index + diff);
       }
       start_index = int(i) + 1;
 
@@ -4449,14 +5135,19 @@ static DataRef handle_json_escapes_out(const std::string &data, std::string &buf
   }
   if (buffer.size())
   {
-    size_t diff = data.size() - start_index;
+    size_t diff = size - start_index;
     if (diff > 0)
     {
-      buffer.insert(buffer.end(), data.data() + start_index, data.data() + start_index + diff);
+      buffer.insert(buffer.end(), data + start_index, data + start_index + diff);
     }
     return DataRef(buffer.data(), buffer.size());
   }
-  return DataRef(data.data(), data.size());
+  return DataRef(data, size);
+}
+
+static DataRef handle_json_escapes_out(const std::string &data, std::string &buffer)
+{
+  return handle_json_escapes_out(data.data(), data.size(), buffer);
 }
 } // namespace Internal
 /// \private
@@ -6548,16 +7239,31 @@ inline int to_buffer(T integer, char *buffer, int buffer_size, int *digits_trunc
   else if (digits_truncated)
     *digits_truncated = 0;
 
-  for (int i = 0; i < chars_to_write; i++)
+  // Two digits per division
+  static const char digit_pairs[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                                    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                                    "8081828384858687888990919293949596979899";
+  int i = chars_to_write;
+  for (; i >= 2; i -= 2)
+  {
+    int remainder = int(integer % 100);
+    if (std::is_signed<T>::value)
+    {
+      if (negative)
+        remainder = -remainder;
+    }
+    integer /= 100;
+    memcpy(target_buffer + i - 2, digit_pairs + 2 * remainder, 2);
+  }
+  if (i)
   {
-    int remainder = integer % 10;
+    int remainder = int(integer % 10);
     if (std::is_signed<T>::value)
     {
       if (negative)
         remainder = -remainder;
     }
-    integer /= 10;
-    target_buffer[chars_to_write - 1 - i] = '0' + char(remainder);
+    target_buffer[0] = '0' + char(remainder);
   }
 
   return chars_to_write + negative;
@@ -7194,6 +7900,187 @@ struct TypeHandler<bool>
   }
 };
 
+namespace Internal
+{
+inline bool isJsonWhiteSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/* Scans a flat array of numbers that is complete in the current tokenizer buffer. Calls on_number with each number
+ * and returns the number of elements, and the offset of the closing bracket in end_offset. Returns false for
+ * anything else, leaving it to the tokenizer. */
+template <typename OnNumber>
+inline bool scanNumberArray(const DataRef &data, size_t &end_offset, size_t &count, OnNumber &&on_number)
+{
+  const char *it = data.data;
+  const char *end = data.data + data.size;
+  count = 0;
+  while (it < end && isJsonWhiteSpace(*it))
+    it++;
+  if (it < end && *it == ']')
+  {
+    end_offset = size_t(it - data.data);
+    return true;
+  }
+  while (it < end)
+  {
+    if (!(lookup()[(unsigned char)*it] & (PlusOrMinus | Digits)))
+      return false;
+    const char *number = it;
+    while (it < end && lookup()[(unsigned char)*it] & NumberEnd)
+      it++;
+    if (!on_number(count, DataRef(number, size_t(it - number))))
+      return false;
+    count++;
+    while (it < end && isJsonWhiteSpace(*it))
+      it++;
+    if (it == end)
+      return false;
+    if (*it == ']')
+    {
+      end_offset = size_t(it - data.data);
+      return true;
+    }
+    if (*it != ',')
+      return false;
+    it++;
+    while (it < end && isJsonWhiteSpace(*it))
+      it++;
+  }
+  return false;
+}
+
+template <typename T>
+struct NumberArrayElementParser
+{
+  std::vector<T> &to_type;
+  ParseContext &context;
+  bool operator()(size_t index, const DataRef &number)
+  {
+    context.token.value = number;
+    return TypeHandler<T>::to(to_type[index], context) == Error::NoError;
+  }
+};
+
+struct NumberArrayCounter
+{
+  bool operator()(size_t, const DataRef &)
+  {
+    return true;
+  }
+};
+
+/* Fast path for arrays of numbers: counts the elements, sizes the vector once and converts the numbers straight from
+ * the buffer without producing a token per element. When anything does not fit, including a number the TypeHandler
+ * rejects, nothing is consumed and the generic path takes over, so errors are reported the same way. */
+template <typename T, bool = std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>
+struct NumberArrayParser
+{
+  static bool parse(std::vector<T> &, ParseContext &)
+  {
+    return false;
+  }
+};
+
+template <typename T>
+struct NumberArrayParser<T, true>
+{
+  static bool parse(std::vector<T> &to_type, ParseContext &context)
+  {
+    DataRef data = context.tokenizer.remainingBufferData();
+    size_t end_offset;
+    size_t count;
+    if (!data.size || !scanNumberArray(data, end_offset, count, NumberArrayCounter()))
+      return false;
+
+    to_type.resize(count);
+    Token array_start = context.token;
+    context.token.name = DataRef();
+    context.token.value_type = Type::Number;
+    NumberArrayElementParser<T> element_parser = {to_type, context};
+    if (!scanNumberArray(data, end_offset, count, element_parser))
+    {
+      context.token = array_start;
+      return false;
+    }
+    context.tokenizer.skipBufferData(end_offset);
+    context.nextToken();
+    return true;
+  }
+};
+
+template <typename T>
+inline int formatNumber(T value, char *buffer, int size, std::true_type)
+{
+  return ft::ryu::to_buffer(value, buffer, size);
+}
+
+template <typename T>
+inline int formatNumber(T value, char *buffer, int size, std::false_type)
+{
+  int digits_truncated;
+  int written = ft::integer::to_buffer(value, buffer, size, &digits_truncated);
+  return digits_truncated ? -1 : written;
+}
+
+/* Writes the first element as a token so the serializer state is that of being inside an array, then formats the
+ * rest, with the delimiters the serializer would add, into a block that is flushed with raw writes. */
+template <typename T, bool = std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>
+struct NumberArraySerializer
+{
+  static bool write(const std::vector<T> &, Token &, Serializer &)
+  {
+    return false;
+  }
+};
+
+template <typename T>
+struct NumberArraySerializer<T, true>
+{
+  static bool write(const std::vector<T> &vec, Token &token, Serializer &serializer)
+  {
+    const size_t max_number_size = 32;
+    char block[4096];
+    if (vec.empty())
+      return true;
+    SerializerOptions options = serializer.options();
+    std::string separator = options.tokenDelimiter() + options.postfix() + options.prefix();
+    if (separator.size() + max_number_size > sizeof(block))
+      return false;
+
+    size_t i = 0;
+    for (; i < vec.size(); i++)
+    {
+      int size = formatNumber(vec[i], block, int(max_number_size), typename std::is_floating_point<T>::type());
+      if (size <= 0)
+        continue;
+      token.value_type = Type::Number;
+      token.value = DataRef(block, size_t(size));
+      serializer.write(token);
+      break;
+    }
+    size_t used = 0;
+    for (i++; i < vec.size(); i++)
+    {
+      if (used + separator.size() + max_number_size > sizeof(block))
+      {
+        serializer.write(block, used);
+        used = 0;
+      }
+      int size = formatNumber(vec[i], block + used + separator.size(), int(max_number_size),
+                              typename std::is_floating_point<T>::type());
+      if (size <= 0)
+        continue;
+      memcpy(block + used, separator.data(), separator.size());
+      used += separator.size() + size_t(size);
+    }
+    serializer.write(block, used);
+    return true;
+  }
+};
+} // namespace Internal
+
 /// \private
 template <typename T>
 struct TypeHandler<std::vector<T>>
@@ -7203,6 +8090,8 @@ public:
   {
     if (context.token.value_type != JS::Type::ArrayStart)
       return Error::ExpectedArrayStart;
+    if (Internal::NumberArrayParser<T>::parse(to_type, context))
+      return context.error;
     Error error = context.nextToken();
     if (error != JS::Error::NoError)
       return error;
@@ -7230,9 +8119,12 @@ public:
 
     token.name = DataRef("");
 
-    for (auto &index : vec)
+    if (!Internal::NumberArraySerializer<T>::write(vec, token, serializer))
     {
-      TypeHandler<T>::from(index, token, serializer);
+      for (auto &index : vec)
+      {
+        TypeHandler<T>::from(index, token, serializer);
+      }
     }
 
     token.name = DataRef("");
@@ -7349,6 +8241,89 @@ public:
   }
 };
 
+/// \private
+template <typename T>
+struct TypeHandler<Memoized<T>>
+{
+public:
+  static inline Error to(Memoized<T> &to_type, ParseContext &context)
+  {
+    T value;
+    Error error = TypeHandler<T>::to(value, context);
+    if (error == Error::NoError)
+      to_type.state = std::make_shared<const Internal::MemoizedState<T>>(std::move(value));
+    return error;
+  }
+
+  static inline void from(const Memoized<T> &memoized, Token &token, Serializer &serializer)
+  {
+    const Internal::MemoizedState<T> &state = *memoized.state;
+    const SerializerOptions options = serializer.options();
+    const bool pretty = options.style() == SerializerOptions::Pretty;
+    std::atomic<const std::string *> &cache = pretty ? state.pretty_json : state.json;
+    const std::string *json = cache.load(std::memory_order_acquire);
+    if (!json)
+    {
+      std::string *serialized = new std::string(serializeStruct(state.value, SerializerOptions(options.style())));
+      if (cache.compare_exchange_strong(json, serialized, std::memory_order_acq_rel))
+        json = serialized;
+      else
+        delete serialized;
+    }
+
+    std::string indented;
+    if (pretty && options.depth())
+    {
+      const std::string &indent = options.prefix();
+      indented.reserve(json->size() + indent.size() * size_t(std::count(json->begin(), json->end(), '\n')));
+      for (char c : *json)
+      {
+        indented += c;
+        if (c == '\n')
+          indented += indent;
+      }
+      json = &indented;
+    }
+    token.value = DataRef(json->data(), json->size());
+    token.value_type = Type::Verbatim;
+    serializer.write(token);
+  }
+};
+
+namespace Internal
+{
+/* Passes the tokens of the container opened by the current token, up to and including its end, to push. Fails when
+ * push returns false or the container is not in one contiguous buffer. */
+template <typename Push>
+inline Error collectContainerTokens(ParseContext &context, Push &&push)
+{
+  bool buffer_change = false;
+  auto ref = context.tokenizer.registerNeedMoreDataCallback([&buffer_change](JS::Tokenizer &tokenizer) {
+    JS_UNUSED(tokenizer);
+    buffer_change = true;
+  });
+
+  size_t level = 1;
+  Error error = Error::NoError;
+  while (error == JS::Error::NoError && level && buffer_change == false)
+  {
+    error = context.nextToken();
+    if (error != JS::Error::NoError)
+      break;
+    if (!push(context.token))
+      return Error::TooLarge;
+    if (context.token.value_type == Type::ArrayStart || context.token.value_type == Type::ObjectStart)
+      level++;
+    else if (context.token.value_type == Type::ArrayEnd || context.token.value_type == Type::ObjectEnd)
+      level--;
+  }
+  if (buffer_change)
+    return Error::NonContigiousMemory;
+
+  return error;
+}
+} // namespace Internal
+
 /// \private
 template <>
 struct TypeHandler<std::vector<Token>>
@@ -7363,27 +8338,10 @@ public:
     }
     to_type.clear();
     to_type.push_back(context.token);
-    bool buffer_change = false;
-    auto ref = context.tokenizer.registerNeedMoreDataCallback([&buffer_change](JS::Tokenizer &tokenizer) {
-      JS_UNUSED(tokenizer);
-      buffer_change = true;
+    return Internal::collectContainerTokens(context, [&to_type](const Token &token) {
+      to_type.push_back(token);
+      return true;
     });
-
-    size_t level = 1;
-    Error error = Error::NoError;
-    while (error == JS::Error::NoError && level && buffer_change == false)
-    {
-      error = context.nextToken();
-      to_type.push_back(context.token);
-      if (context.token.value_type == Type::ArrayStart || context.token.value_type == Type::ObjectStart)
-        level++;
-      else if (context.token.value_type == Type::ArrayEnd || context.token.value_type == Type::ObjectEnd)
-        level--;
-    }
-    if (buffer_change)
-      return Error::NonContigiousMemory;
-
-    return error;
   }
 
   static inline void from(const std::vector<Token> &from_type, Token &token, Serializer &serializer)
@@ -7403,11 +8361,22 @@ struct TypeHandler<JsonTokens>
 public:
   static inline Error to(JsonTokens &to_type, ParseContext &context)
   {
-    return TypeHandler<std::vector<Token>>::to(to_type.data, context);
+    to_type.data.clear();
+    if (!to_type.data.push_back(context.token))
+      return Error::TooLarge;
+    if (context.token.value_type != JS::Type::ArrayStart && context.token.value_type != JS::Type::ObjectStart)
+      return context.error;
+
+    return Internal::collectContainerTokens(
+      context, [&to_type](const Token &token) { return to_type.data.push_back(token); });
   }
   static inline void from(const JsonTokens &from, Token &token, Serializer &serializer)
   {
-    return TypeHandler<std::vector<Token>>::from(from.data, token, serializer);
+    for (const Token &t : from.data)
+    {
+      token = t;
+      serializer.write(token);
+    }
   }
 };
 
@@ -7700,22 +8669,248 @@ struct TypeHandler<JsonObjectOrArray>
   }
 };
 
-namespace Internal
+template <typename T>
+void Lazy<T>::parse() const
 {
-template <size_t INDEX, typename... Ts>
-struct TupleTypeHandler
+  if (parsed)
+    return;
+  parsed = true;
+  ParseContext context(json.data(), json.size());
+  parse_error = context.parseTo(data);
+}
+
+/// \private
+template <typename T>
+struct TypeHandler<Lazy<T>>
 {
-  static inline Error to(JS::Tuple<Ts...> &to_type, ParseContext &context)
+  static inline Error to(Lazy<T> &to_type, ParseContext &context)
   {
-    using Type = typename JS::TypeAt<sizeof...(Ts) - INDEX, Ts...>::type;
-    Error error = TypeHandler<Type>::to(to_type.template get<sizeof...(Ts) - INDEX>(), context);
-    if (error != JS::Error::NoError)
-      return error;
-    error = context.nextToken();
-    if (error != JS::Error::NoError)
-      return error;
-    return TupleTypeHandler<INDEX - 1, Ts...>::to(to_type, context);
-  }
+    to_type.json.clear();
+    to_type.parsed = true;
+    to_type.parse_error = Error::NoError;
+    if (context.token.value_type != Type::ObjectStart && context.token.value_type != Type::ArrayStart)
+      return TypeHandler<T>::to(to_type.data, context);
+
+    JsonObjectOrArrayRef ref;
+    Error error = TypeHandler<JsonObjectOrArrayRef>::to(ref, context);
+    if (error != Error::NoError)
+      return error;
+    to_type.json.assign(ref.ref.data, ref.ref.size);
+    to_type.data = T();
+    to_type.parsed = false;
+    return error;
+  }
+
+  static inline void from(const Lazy<T> &from_type, Token &token, Serializer &serializer)
+  {
+    if (from_type.json.empty())
+      return TypeHandler<T>::from(from_type.data, token, serializer);
+    token.value = DataRef(from_type.json);
+    token.value_type = Type::Verbatim;
+    serializer.write(token);
+  }
+};
+
+namespace Internal
+{
+// Integers have to be written as integers: "1.50" or "1e3" fail instead of being truncated, as do values out of range.
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, Error>::type
+parseRawNumber(const DataRef &number, T &to_type)
+{
+  const bool negative = number.size && number.data[0] == '-';
+  const char *digits = number.data + negative;
+  const size_t digit_count = number.size - negative;
+  if (!digit_count || digit_count > 20)
+    return Error::FailedToParseInt;
+  for (size_t i = 0; i < digit_count; i++)
+  {
+    if (digits[i] < '0' || digits[i] > '9')
+      return Error::FailedToParseInt;
+  }
+  if (digit_count == 20 && memcmp(digits, "18446744073709551615", 20) > 0)
+    return Error::FailedToParseInt;
+
+  uint64_t magnitude;
+  const char *end;
+  if (ft::integer::to_integer(digits, digit_count, magnitude, end) != ft::parse_string_error::ok ||
+      end != digits + digit_count)
+    return Error::FailedToParseInt;
+  const uint64_t max = uint64_t(std::numeric_limits<T>::max());
+  if (!negative)
+  {
+    if (magnitude > max)
+      return Error::FailedToParseInt;
+    to_type = T(magnitude);
+    return Error::NoError;
+  }
+  if (!magnitude)
+  {
+    to_type = T(0);
+    return Error::NoError;
+  }
+  if (!std::is_signed<T>::value || magnitude - 1 > max)
+    return Error::FailedToParseInt;
+  to_type = T(-T(magnitude - 1) - T(1));
+  return Error::NoError;
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value, Error>::type parseRawNumber(const DataRef &number,
+                                                                                             T &to_type)
+{
+  double value;
+  const char *end;
+  if (ft::to_double(number.data, number.size, value, end) != ft::parse_string_error::ok ||
+      end != number.data + number.size)
+    return Error::FailedToParseDouble;
+  to_type = T(value);
+  return Error::NoError;
+}
+
+inline Error parseRawNumber(const DataRef &number, float &to_type)
+{
+  const char *end;
+  if (ft::to_float(number.data, number.size, to_type, end) != ft::parse_string_error::ok ||
+      end != number.data + number.size)
+    return Error::FailedToParseFloat;
+  return Error::NoError;
+}
+
+// Any other type is handed to its TypeHandler with the number as the current token.
+template <typename T>
+inline typename std::enable_if<!std::is_arithmetic<T>::value || std::is_same<T, bool>::value, Error>::type
+parseRawNumber(const DataRef &number, T &to_type)
+{
+  ParseContext context;
+  context.token.value = number;
+  context.token.value_type = Type::Number;
+  return TypeHandler<T>::to(to_type, context);
+}
+
+inline void writeRawNumber(const DataRef &number, Token &token, Serializer &serializer)
+{
+  token.value_type = Type::Number;
+  token.value = number.size ? number : DataRef("0");
+  serializer.write(token);
+}
+} // namespace Internal
+
+template <typename T>
+Error RawNumberRef::parseTo(T &to_type) const
+{
+  return Internal::parseRawNumber(ref, to_type);
+}
+
+template <typename T>
+Error RawNumber::parseTo(T &to_type) const
+{
+  return Internal::parseRawNumber(DataRef(data), to_type);
+}
+
+/// \private
+template <>
+struct TypeHandler<RawNumberRef>
+{
+  static inline Error to(RawNumberRef &to_type, ParseContext &context)
+  {
+    if (context.token.value_type != Type::Number)
+      return Error::IllegalDataValue;
+    to_type.ref = context.token.value;
+    return Error::NoError;
+  }
+
+  static inline void from(const RawNumberRef &from_type, Token &token, Serializer &serializer)
+  {
+    Internal::writeRawNumber(from_type.ref, token, serializer);
+  }
+};
+
+/// \private
+template <>
+struct TypeHandler<RawNumber>
+{
+  static inline Error to(RawNumber &to_type, ParseContext &context)
+  {
+    if (context.token.value_type != Type::Number)
+      return Error::IllegalDataValue;
+    to_type.data.assign(context.token.value.data, context.token.value.size);
+    return Error::NoError;
+  }
+
+  static inline void from(const RawNumber &from_type, Token &token, Serializer &serializer)
+  {
+    Internal::writeRawNumber(DataRef(from_type.data), token, serializer);
+  }
+};
+
+namespace Internal
+{
+inline Error appendUnknownMember(UnknownMembers &unknown, ParseContext &context)
+{
+  UnknownMembers::Member member;
+  member.name_offset = unknown.data.size();
+  member.name_size = context.token.name.size;
+  member.name_type = context.token.name_type;
+  unknown.data.append(context.token.name.data, context.token.name.size);
+
+  DataRef value = context.token.value;
+  member.value_type = context.token.value_type;
+  if (member.value_type == Type::ObjectStart || member.value_type == Type::ArrayStart)
+  {
+    JsonObjectOrArrayRef ref;
+    Error error = TypeHandler<JsonObjectOrArrayRef>::to(ref, context);
+    if (error != Error::NoError)
+      return error;
+    value = ref.ref;
+    member.value_type = Type::Verbatim;
+  }
+  member.value_offset = unknown.data.size();
+  member.value_size = value.size;
+  unknown.data.append(value.data, value.size);
+  unknown.members.push_back(member);
+  return Error::NoError;
+}
+} // namespace Internal
+
+/// \private
+template <>
+struct TypeHandler<UnknownMembers>
+{
+  static inline Error to(UnknownMembers &to_type, ParseContext &context)
+  {
+    return Internal::appendUnknownMember(to_type, context);
+  }
+
+  static inline void from(const UnknownMembers &from_type, Token &token, Serializer &serializer)
+  {
+    for (size_t i = 0; i < from_type.size(); i++)
+    {
+      token.name = from_type.name(i);
+      token.name_type = from_type.members[i].name_type;
+      token.value = from_type.value(i);
+      token.value_type = from_type.members[i].value_type;
+      serializer.write(token);
+    }
+  }
+};
+
+namespace Internal
+{
+template <size_t INDEX, typename... Ts>
+struct TupleTypeHandler
+{
+  static inline Error to(JS::Tuple<Ts...> &to_type, ParseContext &context)
+  {
+    using Type = typename JS::TypeAt<sizeof...(Ts) - INDEX, Ts...>::type;
+    Error error = TypeHandler<Type>::to(to_type.template get<sizeof...(Ts) - INDEX>(), context);
+    if (error != JS::Error::NoError)
+      return error;
+    error = context.nextToken();
+    if (error != JS::Error::NoError)
+      return error;
+    return TupleTypeHandler<INDEX - 1, Ts...>::to(to_type, context);
+  }
 
   static inline void from(const JS::Tuple<Ts...> &from_type, Token &token, Serializer &serializer)
   {
@@ -7987,5 +9182,2602 @@ public:
   }
 };
 #endif
+
+namespace Internal
+{
+inline void appendJsonPointerSegment(std::string &path, const char *data, size_t size)
+{
+  path += '/';
+  for (size_t i = 0; i < size; i++)
+  {
+    if (data[i] == '~')
+      path += "~0";
+    else if (data[i] == '/')
+      path += "~1";
+    else
+      path += data[i];
+  }
+}
+
+// Appends the raw, still escaped, member name of a JSON document as a JSON Pointer segment.
+inline void appendJsonPointerName(std::string &path, const DataRef &name)
+{
+  if (!name.size || !memchr(name.data, '\\', name.size))
+  {
+    appendJsonPointerSegment(path, name.data, name.size);
+    return;
+  }
+  std::string unescaped;
+  handle_json_escapes_in(name, unescaped);
+  appendJsonPointerSegment(path, unescaped.data(), unescaped.size());
+}
+
+// Compares the raw, still escaped, text of a JSON string with unescaped text.
+inline bool isJsonStringEqual(const DataRef &raw, const char *data, size_t size)
+{
+  if (!raw.size || !memchr(raw.data, '\\', raw.size))
+    return raw.size == size && (!size || memcmp(raw.data, data, size) == 0);
+  std::string unescaped;
+  handle_json_escapes_in(raw, unescaped);
+  return unescaped.size() == size && memcmp(unescaped.data(), data, size) == 0;
+}
+
+// FNV-1a
+const uint64_t hashSeed = 14695981039346656037ull;
+
+inline uint64_t hashBytes(uint64_t hash, const char *data, size_t size)
+{
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+inline uint64_t hashValue(uint64_t hash, uint64_t value)
+{
+  return hashBytes(hash, reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T>
+struct IsJsonStruct
+{
+  static constexpr bool value = sizeof(HasJsonStructBase<T>::template test_in_base<T>(nullptr)) ==
+                                sizeof(typename HasJsonStructBase<T>::yes);
+};
+
+template <typename T>
+struct HasEqualOperator
+{
+  template <typename C>
+  static auto test(const C *c) -> decltype(bool(*c == *c), std::true_type());
+  template <typename>
+  static std::false_type test(...);
+  static constexpr bool value = decltype(test<T>(nullptr))::value;
+};
+
+// The operator== of the standard containers compiles for any element type and only fails when instantiated, so
+// look at the elements instead.
+template <typename T, typename A>
+struct HasEqualOperator<std::vector<T, A>> : public HasEqualOperator<T>
+{
+};
+
+template <typename K, typename V>
+struct HasEqualOperator<std::pair<K, V>>
+{
+  static constexpr bool value = HasEqualOperator<K>::value && HasEqualOperator<V>::value;
+};
+
+template <typename K, typename V, typename C, typename A>
+struct HasEqualOperator<std::map<K, V, C, A>> : public HasEqualOperator<std::pair<K, V>>
+{
+};
+
+template <typename K, typename C, typename A>
+struct HasEqualOperator<std::set<K, C, A>> : public HasEqualOperator<K>
+{
+};
+
+#ifdef JS_STD_UNORDERED_MAP
+template <typename K, typename V, typename H, typename E, typename A>
+struct HasEqualOperator<std::unordered_map<K, V, H, E, A>> : public HasEqualOperator<std::pair<K, V>>
+{
+};
+
+template <typename K, typename H, typename E, typename A>
+struct HasEqualOperator<std::unordered_set<K, H, E, A>> : public HasEqualOperator<K>
+{
+};
+#endif
+
+#ifdef JS_STD_OPTIONAL
+template <typename T>
+struct HasEqualOperator<std::optional<T>> : public HasEqualOperator<T>
+{
+};
+#endif
+
+template <typename T, typename Enable = void>
+struct StructCompare
+{
+  static bool equal(const T &a, const T &b)
+  {
+    static_assert(HasEqualOperator<T>::value,
+                  "Members compared by StructCompare need JS_OBJ meta data or an operator==");
+    return a == b;
+  }
+  static void diff(const T &a, const T &b, std::string &path, std::vector<std::string> &changed)
+  {
+    if (!equal(a, b))
+      changed.push_back(path);
+  }
+};
+
+struct StructEqualVisitor
+{
+  bool equal = true;
+  template <typename MemberType>
+  void operator()(const MemberType &a, const MemberType &b, const DataRef &name)
+  {
+    JS_UNUSED(name);
+    if (equal && !StructCompare<MemberType>::equal(a, b))
+      equal = false;
+  }
+};
+
+struct StructDiffVisitor
+{
+  StructDiffVisitor(std::string &path, std::vector<std::string> &changed)
+    : path(path)
+    , changed(changed)
+  {
+  }
+  template <typename MemberType>
+  void operator()(const MemberType &a, const MemberType &b, const DataRef &name)
+  {
+    size_t path_size = path.size();
+    appendJsonPointerSegment(path, name.data, name.size);
+    StructCompare<MemberType>::diff(a, b, path, changed);
+    path.resize(path_size);
+  }
+  std::string &path;
+  std::vector<std::string> &changed;
+};
+
+template <typename T>
+struct StructCompare<T, typename std::enable_if<IsJsonStruct<T>::value>::type>
+{
+  static bool equal(const T &a, const T &b)
+  {
+    StructEqualVisitor visitor;
+    visitStructMembers(a, b, visitor);
+    return visitor.equal;
+  }
+  static void diff(const T &a, const T &b, std::string &path, std::vector<std::string> &changed)
+  {
+    StructDiffVisitor visitor(path, changed);
+    visitStructMembers(a, b, visitor);
+  }
+};
+
+template <typename T, typename A>
+struct StructCompare<std::vector<T, A>, void>
+{
+  static bool equal(const std::vector<T, A> &a, const std::vector<T, A> &b)
+  {
+    if (a.size() != b.size())
+      return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+      if (!StructCompare<T>::equal(a[i], b[i]))
+        return false;
+    }
+    return true;
+  }
+  static void diff(const std::vector<T, A> &a, const std::vector<T, A> &b, std::string &path,
+                   std::vector<std::string> &changed)
+  {
+    if (a.size() != b.size())
+    {
+      changed.push_back(path);
+      return;
+    }
+    size_t path_size = path.size();
+    for (size_t i = 0; i < a.size(); i++)
+    {
+      path += '/';
+      path += std::to_string(i);
+      StructCompare<T>::diff(a[i], b[i], path, changed);
+      path.resize(path_size);
+    }
+  }
+};
+
+template <typename T, typename D>
+struct StructCompare<std::unique_ptr<T, D>, void>
+{
+  static bool equal(const std::unique_ptr<T, D> &a, const std::unique_ptr<T, D> &b)
+  {
+    if (!a || !b)
+      return !a && !b;
+    return StructCompare<T>::equal(*a, *b);
+  }
+  static void diff(const std::unique_ptr<T, D> &a, const std::unique_ptr<T, D> &b, std::string &path,
+                   std::vector<std::string> &changed)
+  {
+    if (!a || !b)
+    {
+      if (a || b)
+        changed.push_back(path);
+      return;
+    }
+    StructCompare<T>::diff(*a, *b, path, changed);
+  }
+};
+
+#ifdef JS_STD_OPTIONAL
+template <typename T>
+struct StructCompare<std::optional<T>, void>
+{
+  static bool equal(const std::optional<T> &a, const std::optional<T> &b)
+  {
+    if (!a || !b)
+      return !a && !b;
+    return StructCompare<T>::equal(*a, *b);
+  }
+  static void diff(const std::optional<T> &a, const std::optional<T> &b, std::string &path,
+                   std::vector<std::string> &changed)
+  {
+    if (!a || !b)
+    {
+      if (a || b)
+        changed.push_back(path);
+      return;
+    }
+    StructCompare<T>::diff(*a, *b, path, changed);
+  }
+};
+#endif
+
+template <typename Wrapper, typename T>
+struct WrapperCompare
+{
+  static bool equal(const Wrapper &a, const Wrapper &b)
+  {
+    return StructCompare<T>::equal(a.data, b.data);
+  }
+  static void diff(const Wrapper &a, const Wrapper &b, std::string &path, std::vector<std::string> &changed)
+  {
+    StructCompare<T>::diff(a.data, b.data, path, changed);
+  }
+};
+
+template <typename T>
+struct StructCompare<Nullable<T>, void> : public WrapperCompare<Nullable<T>, T>
+{
+};
+
+template <typename T>
+struct StructCompare<Optional<T>, void> : public WrapperCompare<Optional<T>, T>
+{
+};
+
+template <typename T>
+struct StructCompare<NullableChecked<T>, void>
+{
+  static bool equal(const NullableChecked<T> &a, const NullableChecked<T> &b)
+  {
+    if (a.null || b.null)
+      return a.null == b.null;
+    return StructCompare<T>::equal(a.data, b.data);
+  }
+  static void diff(const NullableChecked<T> &a, const NullableChecked<T> &b, std::string &path,
+                   std::vector<std::string> &changed)
+  {
+    if (a.null || b.null)
+    {
+      if (a.null != b.null)
+        changed.push_back(path);
+      return;
+    }
+    StructCompare<T>::diff(a.data, b.data, path, changed);
+  }
+};
+
+template <typename T>
+struct StructCompare<OptionalChecked<T>, void>
+{
+  static bool equal(const OptionalChecked<T> &a, const OptionalChecked<T> &b)
+  {
+    if (!a.assigned || !b.assigned)
+      return a.assigned == b.assigned;
+    return StructCompare<T>::equal(a.data, b.data);
+  }
+  static void diff(const OptionalChecked<T> &a, const OptionalChecked<T> &b, std::string &path,
+                   std::vector<std::string> &changed)
+  {
+    if (!a.assigned || !b.assigned)
+    {
+      if (a.assigned != b.assigned)
+        changed.push_back(path);
+      return;
+    }
+    StructCompare<T>::diff(a.data, b.data, path, changed);
+  }
+};
+
+// Keys are looked up with the container's own comparison or hash, and mapped values are compared recursively.
+template <typename Map>
+struct MapCompare
+{
+  static bool equal(const Map &a, const Map &b)
+  {
+    if (a.size() != b.size())
+      return false;
+    for (const auto &item : a)
+    {
+      auto it = b.find(item.first);
+      if (it == b.end() || !StructCompare<typename Map::mapped_type>::equal(item.second, it->second))
+        return false;
+    }
+    return true;
+  }
+  static void diff(const Map &a, const Map &b, std::string &path, std::vector<std::string> &changed)
+  {
+    if (!equal(a, b))
+      changed.push_back(path);
+  }
+};
+
+template <typename Set>
+struct SetCompare
+{
+  static bool equal(const Set &a, const Set &b)
+  {
+    if (a.size() != b.size())
+      return false;
+    for (const auto &item : a)
+    {
+      if (b.find(item) == b.end())
+        return false;
+    }
+    return true;
+  }
+  static void diff(const Set &a, const Set &b, std::string &path, std::vector<std::string> &changed)
+  {
+    if (!equal(a, b))
+      changed.push_back(path);
+  }
+};
+
+template <typename K, typename V, typename C, typename A>
+struct StructCompare<std::map<K, V, C, A>, void> : public MapCompare<std::map<K, V, C, A>>
+{
+};
+
+template <typename K, typename C, typename A>
+struct StructCompare<std::set<K, C, A>, void> : public SetCompare<std::set<K, C, A>>
+{
+};
+
+#ifdef JS_STD_UNORDERED_MAP
+template <typename K, typename V, typename H, typename E, typename A>
+struct StructCompare<std::unordered_map<K, V, H, E, A>, void> : public MapCompare<std::unordered_map<K, V, H, E, A>>
+{
+};
+
+template <typename K, typename H, typename E, typename A>
+struct StructCompare<std::unordered_set<K, H, E, A>, void> : public SetCompare<std::unordered_set<K, H, E, A>>
+{
+};
+#endif
+} // namespace Internal
+
+/*! \brief Compares two structs member by member using the JS_OBJ meta data and returns the JSON Pointer paths of
+ *  the members that differ, ie. "/address/city" or "/friends/1/name".
+ *
+ *  Members that are JS_OBJ structs, vectors, pointers or Optional/Nullable wrappers are walked recursively, and
+ *  super class members are reported as members of the struct itself. A vector that changed size is reported as one
+ *  path, as is a map or set that differs. Map values are compared recursively, and remaining members are compared
+ *  with operator==. A member type with neither JS_OBJ meta data nor operator== is a compile error.
+ */
+template <typename T>
+std::vector<std::string> diffStructs(const T &a, const T &b)
+{
+  std::vector<std::string> changed;
+  std::string path;
+  Internal::StructDiffVisitor visitor(path, changed);
+  Internal::visitStructMembers(a, b, visitor);
+  return changed;
+}
+
+namespace Internal
+{
+// Writes the delta of a struct. The object start of a nested struct is held back until one of its members is written,
+// so nested structs without changes do not leave an empty object behind.
+struct DeltaWriter
+{
+  DeltaWriter(Token &token, Serializer &serializer)
+    : token(token)
+    , serializer(serializer)
+  {
+  }
+
+  // Writes the held back object starts. Call before writing a value with token, which keeps its name.
+  Serializer &begin()
+  {
+    if (written < pending.size())
+    {
+      const DataRef name = token.name;
+      const Type name_type = token.name_type;
+      for (; written < pending.size(); written++)
+      {
+        token.name = pending[written];
+        token.name_type = Type::Ascii;
+        writeObjectStart();
+      }
+      token.name = name;
+      token.name_type = name_type;
+    }
+    return serializer;
+  }
+
+  void writeObjectStart()
+  {
+    static const char objectStart[] = "{";
+    token.value_type = Type::ObjectStart;
+    token.value = DataRef(objectStart);
+    serializer.write(token);
+  }
+
+  void writeObjectEnd()
+  {
+    static const char objectEnd[] = "}";
+    token.name.size = 0;
+    token.name.data = "";
+    token.name_type = Type::String;
+    token.value_type = Type::ObjectEnd;
+    token.value = DataRef(objectEnd);
+    serializer.write(token);
+  }
+
+  void writeNull()
+  {
+    static const char nullChar[] = "null";
+    begin();
+    token.value_type = Type::Null;
+    token.value = DataRef(nullChar);
+    serializer.write(token);
+  }
+
+  Token &token;
+  Serializer &serializer;
+  std::vector<DataRef> pending; // Names of the nested structs being walked
+  size_t written = 0;           // Number of pending object starts that have been written
+};
+
+template <typename T, typename Enable = void>
+struct StructDelta
+{
+  static void write(const T &current, const T &previous, DeltaWriter &writer)
+  {
+    if (!StructCompare<T>::equal(current, previous))
+      TypeHandler<T>::from(current, writer.token, writer.begin());
+  }
+};
+
+struct StructDeltaVisitor
+{
+  explicit StructDeltaVisitor(DeltaWriter &writer)
+    : writer(writer)
+  {
+  }
+  template <typename MemberType>
+  void operator()(const MemberType &current, const MemberType &previous, const DataRef &name)
+  {
+    writer.token.name = name;
+    writer.token.name_type = Type::Ascii;
+    StructDelta<MemberType>::write(current, previous, writer);
+  }
+  DeltaWriter &writer;
+};
+
+template <typename T>
+void writeStructDelta(const T &current, const T &previous, Token &token, Serializer &serializer)
+{
+  DeltaWriter writer(token, serializer);
+  writer.writeObjectStart();
+  StructDeltaVisitor visitor(writer);
+  visitStructMembers(current, previous, visitor);
+  writer.writeObjectEnd();
+}
+
+template <typename T>
+struct StructDelta<T, typename std::enable_if<IsJsonStruct<T>::value>::type>
+{
+  static void write(const T &current, const T &previous, DeltaWriter &writer)
+  {
+    writer.pending.push_back(writer.token.name);
+    StructDeltaVisitor visitor(writer);
+    visitStructMembers(current, previous, visitor);
+    if (writer.written == writer.pending.size())
+    {
+      writer.writeObjectEnd();
+      writer.written--;
+    }
+    writer.pending.pop_back();
+  }
+};
+
+template <typename T>
+struct OptionalDelta
+{
+  static void write(const T *current, const T *previous, DeltaWriter &writer)
+  {
+    if (!current)
+    {
+      if (previous)
+        writer.writeNull();
+    }
+    else if (!previous)
+    {
+      TypeHandler<T>::from(*current, writer.token, writer.begin());
+    }
+    else
+    {
+      StructDelta<T>::write(*current, *previous, writer);
+    }
+  }
+};
+
+template <typename T, typename D>
+struct StructDelta<std::unique_ptr<T, D>, void>
+{
+  static void write(const std::unique_ptr<T, D> &current, const std::unique_ptr<T, D> &previous, DeltaWriter &writer)
+  {
+    OptionalDelta<T>::write(current.get(), previous.get(), writer);
+  }
+};
+
+#ifdef JS_STD_OPTIONAL
+template <typename T>
+struct StructDelta<std::optional<T>, void>
+{
+  static void write(const std::optional<T> &current, const std::optional<T> &previous, DeltaWriter &writer)
+  {
+    OptionalDelta<T>::write(current ? &*current : nullptr, previous ? &*previous : nullptr, writer);
+  }
+};
+#endif
+
+template <typename T>
+struct StructDelta<OptionalChecked<T>, void>
+{
+  static void write(const OptionalChecked<T> &current, const OptionalChecked<T> &previous, DeltaWriter &writer)
+  {
+    OptionalDelta<T>::write(current.assigned ? &current.data : nullptr,
+                            previous.assigned ? &previous.data : nullptr, writer);
+  }
+};
+
+template <typename T>
+struct StructDelta<NullableChecked<T>, void>
+{
+  static void write(const NullableChecked<T> &current, const NullableChecked<T> &previous, DeltaWriter &writer)
+  {
+    OptionalDelta<T>::write(current.null ? nullptr : &current.data, previous.null ? nullptr : &previous.data, writer);
+  }
+};
+
+template <typename T>
+struct StructDelta<Nullable<T>, void>
+{
+  static void write(const Nullable<T> &current, const Nullable<T> &previous, DeltaWriter &writer)
+  {
+    StructDelta<T>::write(current.data, previous.data, writer);
+  }
+};
+
+template <typename T>
+struct StructDelta<Optional<T>, void>
+{
+  static void write(const Optional<T> &current, const Optional<T> &previous, DeltaWriter &writer)
+  {
+    StructDelta<T>::write(current.data, previous.data, writer);
+  }
+};
+} // namespace Internal
+
+/*! \brief Serializes only the members of \p current that differ from \p previous, as a JSON merge patch (RFC 7386).
+ *
+ *  Nested JS_OBJ structs are walked once and written as objects holding their changed members, or left out when
+ *  none of them changed. Members that became null or unassigned are written as null, and any other changed member
+ *  (including vectors, since a merge patch can only replace arrays) is written in full. Identical structs produce an
+ *  empty object. Parsing the result into a copy of \p previous with ParseContext::parseTo brings it up to date with
+ *  \p current, as long as no OptionalChecked or NullableChecked member went from assigned to unassigned.
+ */
+template <typename T>
+std::string serializeStructDelta(const T &current, const T &previous)
+{
+  std::string ret_string;
+  SerializerContext serializeContext(ret_string);
+  Token token;
+  Internal::writeStructDelta(current, previous, token, serializeContext.serializer);
+  serializeContext.flush();
+  return ret_string;
+}
+
+template <typename T>
+std::string serializeStructDelta(const T &current, const T &previous, const SerializerOptions &options)
+{
+  std::string ret_string;
+  SerializerContext serializeContext(ret_string);
+  serializeContext.serializer.setOptions(options);
+  Token token;
+  Internal::writeStructDelta(current, previous, token, serializeContext.serializer);
+  serializeContext.flush();
+  return ret_string;
+}
+
+namespace Internal
+{
+template <typename T>
+struct AlwaysFalse
+{
+  static constexpr bool value = false;
+};
+
+template <typename T, typename Enable = void>
+struct StructHash
+{
+  static_assert(AlwaysFalse<T>::value, "StructHash has no hash for this member type, add a StructHash specialization");
+  static uint64_t hash(uint64_t seed, const T &value);
+};
+
+template <typename T>
+struct StructHash<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type>
+{
+  static uint64_t hash(uint64_t seed, const T &value)
+  {
+    return hashValue(seed, static_cast<uint64_t>(value));
+  }
+};
+
+template <typename T>
+struct StructHash<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+  static uint64_t hash(uint64_t seed, const T &value)
+  {
+    // 0.0 and -0.0 compare equal, so they have to hash equal
+    double d = value == T(0) ? 0.0 : double(value);
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return hashValue(seed, bits);
+  }
+};
+
+template <>
+struct StructHash<std::string, void>
+{
+  static uint64_t hash(uint64_t seed, const std::string &value)
+  {
+    return hashBytes(hashValue(seed, value.size()), value.data(), value.size());
+  }
+};
+
+struct StructHashVisitor
+{
+  uint64_t hash;
+  template <typename MemberType>
+  void operator()(const MemberType &value, const MemberType &same, const DataRef &name)
+  {
+    JS_UNUSED(same);
+    JS_UNUSED(name);
+    hash = StructHash<MemberType>::hash(hash, value);
+  }
+};
+
+template <typename T>
+uint64_t hashStructMembers(uint64_t seed, const T &value)
+{
+  StructHashVisitor visitor;
+  visitor.hash = seed;
+  visitStructMembers(value, value, visitor);
+  return visitor.hash;
+}
+
+template <typename T>
+struct StructHash<T, typename std::enable_if<IsJsonStruct<T>::value>::type>
+{
+  static uint64_t hash(uint64_t seed, const T &value)
+  {
+    return hashStructMembers(seed, value);
+  }
+};
+
+template <typename T, typename A>
+struct StructHash<std::vector<T, A>, void>
+{
+  static uint64_t hash(uint64_t seed, const std::vector<T, A> &value)
+  {
+    seed = hashValue(seed, value.size());
+    for (const auto &item : value)
+      seed = StructHash<T>::hash(seed, item);
+    return seed;
+  }
+};
+
+// Ordered containers iterate equal contents in the same order, so the items are hashed in sequence like a vector.
+template <typename Container>
+struct OrderedContainerHash
+{
+  template <typename K>
+  static uint64_t hashItem(uint64_t seed, const K &key)
+  {
+    return StructHash<K>::hash(seed, key);
+  }
+  template <typename K, typename V>
+  static uint64_t hashItem(uint64_t seed, const std::pair<const K, V> &item)
+  {
+    return StructHash<V>::hash(StructHash<K>::hash(seed, item.first), item.second);
+  }
+  static uint64_t hash(uint64_t seed, const Container &value)
+  {
+    seed = hashValue(seed, value.size());
+    for (const auto &item : value)
+      seed = hashItem(seed, item);
+    return seed;
+  }
+};
+
+// Unordered containers that compare equal can iterate in different orders, so each item is hashed on its own and the
+// item hashes are combined with a sum, which does not depend on the order.
+template <typename Container>
+struct UnorderedContainerHash
+{
+  static uint64_t hash(uint64_t seed, const Container &value)
+  {
+    uint64_t sum = 0;
+    for (const auto &item : value)
+      sum += OrderedContainerHash<Container>::hashItem(hashSeed, item);
+    return hashValue(hashValue(seed, value.size()), sum);
+  }
+};
+
+template <typename K, typename V, typename C, typename A>
+struct StructHash<std::map<K, V, C, A>, void> : public OrderedContainerHash<std::map<K, V, C, A>>
+{
+};
+
+template <typename K, typename C, typename A>
+struct StructHash<std::set<K, C, A>, void> : public OrderedContainerHash<std::set<K, C, A>>
+{
+};
+
+#ifdef JS_STD_UNORDERED_MAP
+template <typename K, typename V, typename H, typename E, typename A>
+struct StructHash<std::unordered_map<K, V, H, E, A>, void>
+  : public UnorderedContainerHash<std::unordered_map<K, V, H, E, A>>
+{
+};
+
+template <typename K, typename H, typename E, typename A>
+struct StructHash<std::unordered_set<K, H, E, A>, void> : public UnorderedContainerHash<std::unordered_set<K, H, E, A>>
+{
+};
+#endif
+
+template <typename T>
+struct OptionalHash
+{
+  static uint64_t hash(uint64_t seed, const T *value)
+  {
+    if (!value)
+      return hashValue(seed, 0);
+    return StructHash<T>::hash(hashValue(seed, 1), *value);
+  }
+};
+
+template <typename T, typename D>
+struct StructHash<std::unique_ptr<T, D>, void>
+{
+  static uint64_t hash(uint64_t seed, const std::unique_ptr<T, D> &value)
+  {
+    return OptionalHash<T>::hash(seed, value.get());
+  }
+};
+
+#ifdef JS_STD_OPTIONAL
+template <typename T>
+struct StructHash<std::optional<T>, void>
+{
+  static uint64_t hash(uint64_t seed, const std::optional<T> &value)
+  {
+    return OptionalHash<T>::hash(seed, value ? &*value : nullptr);
+  }
+};
+#endif
+
+template <typename T>
+struct StructHash<OptionalChecked<T>, void>
+{
+  static uint64_t hash(uint64_t seed, const OptionalChecked<T> &value)
+  {
+    return OptionalHash<T>::hash(seed, value.assigned ? &value.data : nullptr);
+  }
+};
+
+template <typename T>
+struct StructHash<NullableChecked<T>, void>
+{
+  static uint64_t hash(uint64_t seed, const NullableChecked<T> &value)
+  {
+    return OptionalHash<T>::hash(seed, value.null ? nullptr : &value.data);
+  }
+};
+
+template <typename T>
+struct StructHash<Nullable<T>, void>
+{
+  static uint64_t hash(uint64_t seed, const Nullable<T> &value)
+  {
+    return StructHash<T>::hash(seed, value.data);
+  }
+};
+
+template <typename T>
+struct StructHash<Optional<T>, void>
+{
+  static uint64_t hash(uint64_t seed, const Optional<T> &value)
+  {
+    return StructHash<T>::hash(seed, value.data);
+  }
+};
+} // namespace Internal
+
+/*! \brief Hashes a struct member by member using the JS_OBJ meta data, without serializing it.
+ *
+ *  Structs that compare equal with equalStructs hash to the same value, so the pair can be used for hash containers
+ *  keyed on JS_OBJ types. Unordered maps and sets hash the same whatever order their items are in. A member type
+ *  without a StructHash specialization is a compile error.
+ */
+template <typename T>
+uint64_t hashStruct(const T &value)
+{
+  return Internal::hashStructMembers(Internal::hashSeed, value);
+}
+
+/*! \brief Compares two structs member by member using the JS_OBJ meta data, like diffStructs but stopping at the
+ *  first difference.
+ */
+template <typename T>
+bool equalStructs(const T &a, const T &b)
+{
+  Internal::StructEqualVisitor visitor;
+  Internal::visitStructMembers(a, b, visitor);
+  return visitor.equal;
+}
+
+namespace Internal
+{
+inline std::string decodeJsonPointerSegment(const char *data, size_t size)
+{
+  std::string segment;
+  for (size_t i = 0; i < size; i++)
+  {
+    if (data[i] == '~' && i + 1 < size && (data[i + 1] == '0' || data[i + 1] == '1'))
+    {
+      segment += data[i + 1] == '0' ? '~' : '/';
+      i++;
+    }
+    else
+    {
+      segment += data[i];
+    }
+  }
+  return segment;
+}
+
+inline bool parseJsonPointerIndex(const std::string &segment, size_t &index)
+{
+  if (segment.empty() || segment.size() > 19 || (segment.size() > 1 && segment[0] == '0'))
+    return false;
+  index = 0;
+  for (char c : segment)
+  {
+    if (c < '0' || c > '9')
+      return false;
+    index = index * 10 + size_t(c - '0');
+  }
+  return true;
+}
+
+// Moves the tokenizer to the token closing the object or array that token opens.
+inline Error skipJsonContainer(Tokenizer &tokenizer, Token &token)
+{
+  size_t level = 1;
+  while (level)
+  {
+    Error error = tokenizer.nextToken(token);
+    if (error != Error::NoError)
+      return error;
+    if (token.value_type == Type::ObjectStart || token.value_type == Type::ArrayStart)
+      level++;
+    else if (token.value_type == Type::ObjectEnd || token.value_type == Type::ArrayEnd)
+      level--;
+  }
+  return Error::NoError;
+}
+} // namespace Internal
+
+namespace Internal
+{
+// Set by resolveJsonPointer when only the last segment of the pointer is missing from an existing object or array.
+struct JsonPointerMiss
+{
+  bool last = false;
+  std::string segment; // Decoded last segment
+  size_t count = 0;    // Children of the parent that were walked before giving up
+};
+
+/* Follows the JSON Pointer (RFC 6901) from the value cursor is on. Cursor provides type() and name() of the current
+ * value, firstChild() moving into the current object and nextSibling() moving past the current value, where both
+ * return Error::NodeNotFound at the end of the object, and arrayItem(index, count) moving to an item of the current
+ * array and counting the items it passes. Member names are unescaped before they are compared with the segments. On
+ * success the cursor is on the value the pointer refers to.
+ */
+template <typename Cursor>
+Error resolveJsonPointer(Cursor &cursor, const char *pointer, size_t pointer_size, JsonPointerMiss *miss)
+{
+  size_t pos = 0;
+  while (pos < pointer_size)
+  {
+    if (pointer[pos] != '/')
+      return Error::NodeNotFound;
+    size_t end = pos + 1;
+    while (end < pointer_size && pointer[end] != '/')
+      end++;
+    std::string segment = decodeJsonPointerSegment(pointer + pos + 1, end - pos - 1);
+    const bool last = end == pointer_size;
+    pos = end;
+
+    const Type container = cursor.type();
+    if (container != Type::ObjectStart && container != Type::ArrayStart)
+      return Error::NodeNotFound;
+    size_t index = 0;
+    const bool isIndex = container == Type::ArrayStart && parseJsonPointerIndex(segment, index);
+    size_t count = 0;
+    Error error = Error::NodeNotFound;
+    if (container == Type::ObjectStart)
+    {
+      error = cursor.firstChild();
+      while (error == Error::NoError && !isJsonStringEqual(cursor.name(), segment.data(), segment.size()))
+      {
+        count++;
+        error = cursor.nextSibling();
+      }
+    }
+    else if (isIndex)
+    {
+      error = cursor.arrayItem(index, count);
+    }
+    if (error != Error::NoError)
+    {
+      if (last && miss && error == Error::NodeNotFound)
+      {
+        miss->last = true;
+        miss->segment = std::move(segment);
+        miss->count = count;
+      }
+      return error;
+    }
+  }
+  return Error::NoError;
+}
+
+struct TokenizerPointerCursor
+{
+  Type type() const
+  {
+    return token.value_type;
+  }
+  DataRef name() const
+  {
+    return token.name;
+  }
+  Error firstChild()
+  {
+    Error error = tokenizer.nextToken(token);
+    if (error != Error::NoError)
+      return error;
+    return token.value_type == Type::ObjectEnd || token.value_type == Type::ArrayEnd ? Error::NodeNotFound
+                                                                                     : Error::NoError;
+  }
+  Error nextSibling()
+  {
+    if (token.value_type == Type::ObjectStart || token.value_type == Type::ArrayStart)
+    {
+      Error error = skipJsonContainer(tokenizer, token);
+      if (error != Error::NoError)
+        return error;
+    }
+    return firstChild();
+  }
+  Error arrayItem(size_t index, size_t &count)
+  {
+    Error error = firstChild();
+    while (error == Error::NoError && count < index)
+    {
+      count++;
+      error = nextSibling();
+    }
+    return error;
+  }
+
+  Tokenizer tokenizer;
+  Token token;
+};
+} // namespace Internal
+
+/*! \brief Finds the value the JSON Pointer (RFC 6901) \p pointer refers to in \p json and sets \p value to its text.
+ *
+ *  The text includes the quotes of a string and the brackets of an object or array. Tokenizing stops at the end of
+ *  the value, and siblings on the way there are skipped without being parsed. Member names are unescaped before they
+ *  are compared with the segments of the pointer. Returns Error::NodeNotFound when there is no such value.
+ */
+inline Error findJsonPointer(const char *json, size_t size, const char *pointer, size_t pointer_size, DataRef &value)
+{
+  Internal::TokenizerPointerCursor cursor;
+  cursor.tokenizer.addData(json, size);
+  Error error = cursor.tokenizer.nextToken(cursor.token);
+  if (error != Error::NoError)
+    return error;
+  error = Internal::resolveJsonPointer(cursor, pointer, pointer_size, nullptr);
+  if (error != Error::NoError)
+    return error;
+
+  Token &token = cursor.token;
+  if (token.value_type == Type::ObjectStart || token.value_type == Type::ArrayStart)
+  {
+    const char *start = token.value.data;
+    error = Internal::skipJsonContainer(cursor.tokenizer, token);
+    if (error != Error::NoError)
+      return error;
+    value = DataRef(start, size_t(token.value.data + token.value.size - start));
+  }
+  else if (token.value_type == Type::String)
+  {
+    value = DataRef(token.value.data - 1, token.value.size + 2);
+  }
+  else
+  {
+    value = token.value;
+  }
+  return Error::NoError;
+}
+
+/*! \brief Replaces the value at the JSON Pointer \p pointer in \p json with the JSON text \p value.
+ *
+ *  The new text is spliced into the byte range of the old value, so the rest of the document is left exactly as it
+ *  was and nothing is reserialized. \p value is inserted as is and has to be valid JSON.
+ */
+inline Error replaceJsonPointer(std::string &json, const std::string &pointer, const char *value, size_t value_size)
+{
+  DataRef current;
+  Error error = findJsonPointer(json.data(), json.size(), pointer.data(), pointer.size(), current);
+  if (error != Error::NoError)
+    return error;
+  json.replace(size_t(current.data - json.data()), current.size, value, value_size);
+  return Error::NoError;
+}
+
+inline Error replaceJsonPointer(std::string &json, const std::string &pointer, const std::string &value)
+{
+  return replaceJsonPointer(json, pointer, value.data(), value.size());
+}
+
+namespace Internal
+{
+typedef Error (*ExtractParser)(void *target, ParseContext &context);
+
+template <typename T>
+Error extractParse(void *target, ParseContext &context)
+{
+  return TypeHandler<T>::to(*static_cast<T *>(target), context);
+}
+
+struct ExtractPath
+{
+  std::vector<std::string> segments;
+  std::vector<size_t> indices; // Segment as array index, or size_t(-1)
+  bool found = false;
+};
+
+struct ExtractState
+{
+  std::vector<ExtractPath> paths;
+  void **targets;
+  const ExtractParser *parsers;
+  size_t remaining;
+};
+
+inline void parseExtractPath(const std::string &pointer, ExtractPath &path)
+{
+  size_t pos = 0;
+  while (pos < pointer.size())
+  {
+    size_t end = pointer.find('/', pos + 1);
+    if (end == std::string::npos)
+      end = pointer.size();
+    path.segments.push_back(decodeJsonPointerSegment(pointer.data() + pos + 1, end - pos - 1));
+    size_t index;
+    path.indices.push_back(parseJsonPointerIndex(path.segments.back(), index) ? index : size_t(-1));
+    pos = end;
+  }
+}
+
+inline Error extractFromContainer(ExtractState &state, ParseContext &context, size_t depth,
+                                  const std::vector<size_t> &candidates);
+
+// Parses the value in context.token for several paths, when paths repeat or one path is a prefix of another. Each
+// path ending at depth is parsed from a context of its own over the value, and the deeper paths are walked in yet
+// another, while context itself skips the value.
+inline Error extractShared(ExtractState &state, ParseContext &context, size_t depth, const std::vector<size_t> &ending,
+                           const std::vector<size_t> &deeper)
+{
+  const Token token = context.token;
+  const bool is_container = token.value_type == Type::ObjectStart || token.value_type == Type::ArrayStart;
+  DataRef text = token.value;
+  if (is_container)
+  {
+    if (!skipArrayOrObject(context))
+      return context.error;
+    text.size = size_t(context.token.value.data + context.token.value.size - token.value.data);
+  }
+
+  for (size_t candidate : ending)
+  {
+    ParseContext value_context;
+    if (is_container)
+    {
+      value_context.tokenizer.addData(text.data, text.size);
+      if (value_context.nextToken() != Error::NoError)
+        return value_context.error;
+    }
+    else
+    {
+      value_context.token = token;
+    }
+    Error error = state.parsers[candidate](state.targets[candidate], value_context);
+    if (error != Error::NoError)
+      return error;
+    state.paths[candidate].found = true;
+    state.remaining--;
+  }
+
+  if (!is_container || deeper.empty())
+    return Error::NoError;
+  ParseContext value_context(text.data, text.size);
+  if (value_context.nextToken() != Error::NoError)
+    return value_context.error;
+  return extractFromContainer(state, value_context, depth, deeper);
+}
+
+// Parses context.token into the target of the candidate path ending at depth, or walks into it if it is an object or
+// array that longer candidate paths point into. Anything else is skipped.
+inline Error extractValue(ExtractState &state, ParseContext &context, size_t depth,
+                          const std::vector<size_t> &candidates)
+{
+  std::vector<size_t> ending;
+  std::vector<size_t> deeper;
+  for (size_t candidate : candidates)
+  {
+    if (state.paths[candidate].found)
+      continue;
+    if (state.paths[candidate].segments.size() == depth)
+      ending.push_back(candidate);
+    else
+      deeper.push_back(candidate);
+  }
+
+  const bool is_container =
+    context.token.value_type == Type::ObjectStart || context.token.value_type == Type::ArrayStart;
+  if (ending.size() > 1 || (ending.size() == 1 && is_container && !deeper.empty()))
+    return extractShared(state, context, depth, ending, deeper);
+  if (ending.size() == 1)
+  {
+    Error error = state.parsers[ending[0]](state.targets[ending[0]], context);
+    if (error != Error::NoError)
+      return error;
+    state.paths[ending[0]].found = true;
+    state.remaining--;
+    return Error::NoError;
+  }
+
+  if (!is_container)
+    return Error::NoError;
+  if (deeper.empty())
+    return skipArrayOrObject(context) ? Error::NoError : context.error;
+  return extractFromContainer(state, context, depth, deeper);
+}
+
+inline Error extractFromContainer(ExtractState &state, ParseContext &context, size_t depth,
+                                  const std::vector<size_t> &candidates)
+{
+  const bool is_object = context.token.value_type == Type::ObjectStart;
+  const Type end_type = is_object ? Type::ObjectEnd : Type::ArrayEnd;
+  std::vector<size_t> matching;
+  size_t index = 0;
+  if (context.nextToken() != Error::NoError)
+    return context.error;
+  while (context.token.value_type != end_type)
+  {
+    matching.clear();
+    for (size_t candidate : candidates)
+    {
+      const ExtractPath &path = state.paths[candidate];
+      const std::string &segment = path.segments[depth];
+      bool match = is_object ? isJsonStringEqual(context.token.name, segment.data(), segment.size())
+                             : path.indices[depth] == index;
+      if (match)
+        matching.push_back(candidate);
+    }
+    Error error = extractValue(state, context, depth + 1, matching);
+    if (error != Error::NoError || state.remaining == 0)
+      return error;
+    index++;
+    if (context.nextToken() != Error::NoError)
+      return context.error;
+  }
+  return Error::NoError;
+}
+} // namespace Internal
+
+/*! \brief Parses the values at the JSON Pointers in \p paths into \p targets, one target per path and in the same
+ *  order, using their TypeHandlers.
+ *
+ *  The document is tokenized once. Subtrees no path points into are skipped without being parsed, and tokenizing stops
+ *  as soon as every path has been found. Returns Error::NodeNotFound if some path was not found; the targets of the
+ *  paths that were found are still assigned. Repeated paths, and paths where one is a prefix of another, all get their
+ *  targets assigned; the value they share is then parsed once per target.
+ */
+template <typename T, typename... Ts>
+Error extract(const char *json, size_t size, const std::vector<std::string> &paths, T &target, Ts &... targets)
+{
+  if (paths.size() != sizeof...(Ts) + 1)
+    return Error::UnknownError;
+  void *target_pointers[] = {static_cast<void *>(&target), static_cast<void *>(&targets)...};
+  const Internal::ExtractParser parsers[] = {&Internal::extractParse<T>, &Internal::extractParse<Ts>...};
+
+  Internal::ExtractState state;
+  state.targets = target_pointers;
+  state.parsers = parsers;
+  state.remaining = paths.size();
+  state.paths.resize(paths.size());
+  std::vector<size_t> candidates;
+  for (size_t i = 0; i < paths.size(); i++)
+  {
+    Internal::parseExtractPath(paths[i], state.paths[i]);
+    if (paths[i].empty() || paths[i][0] == '/')
+      candidates.push_back(i);
+  }
+
+  ParseContext context(json, size);
+  if (context.nextToken() != Error::NoError)
+    return context.error;
+  Error error = Internal::extractValue(state, context, 0, candidates);
+  if (error != Error::NoError)
+    return error;
+  for (const Internal::ExtractPath &path : state.paths)
+  {
+    if (!path.found)
+      return Error::NodeNotFound;
+  }
+  return Error::NoError;
+}
+
+template <typename T, typename... Ts>
+Error extract(const std::string &json, const std::vector<std::string> &paths, T &target, Ts &... targets)
+{
+  return extract(json.data(), json.size(), paths, target, targets...);
+}
+
+/*! \brief Running statistics of the numbers found at one JsonAggregator query path.
+ *
+ *  Bin i of \p histogram counts the values in [bounds[i - 1], bounds[i]), with the first and last bins open ended.
+ */
+struct AggregateResult
+{
+  AggregateResult()
+    : count(0)
+    , sum(0.0)
+    , min(std::numeric_limits<double>::infinity())
+    , max(-std::numeric_limits<double>::infinity())
+  {
+  }
+  double mean() const
+  {
+    return count ? sum / double(count) : 0.0;
+  }
+
+  size_t count;
+  double sum;
+  double min;
+  double max;
+  std::vector<double> bounds;
+  std::vector<size_t> histogram;
+};
+
+/// \brief Computes count, sum, min, max and histograms of the numbers at a set of paths in a single streaming pass.
+///
+/// Paths are JSON Pointers where a "*" segment matches every member of an object or item of an array, ie.
+/// "/items/*/price". Values that are not numbers are ignored. Feed the document in chunks with addData() and call
+/// process() after each one. A chunk has to stay valid until process() has moved past it.
+class JsonAggregator
+{
+public:
+  /*! Returns the index to pass to result(), or size_t(-1) if \p path is neither empty nor starts with a '/'. */
+  size_t addQuery(const std::string &path);
+  size_t addQuery(const std::string &path, const std::vector<double> &histogram_bounds);
+  void addData(const char *data, size_t size);
+
+  /*! Consumes the tokens of the data added so far. Returns Error::NoError when the added data ends a document and
+   * Error::NeedMoreData when it ends inside one. */
+  Error process();
+
+  const AggregateResult &result(size_t query) const;
+  std::string makeErrorString() const;
+
+private:
+  struct Query
+  {
+    std::vector<std::string> segments;
+    std::vector<size_t> indices;
+    AggregateResult result;
+  };
+  struct Level
+  {
+    bool is_object;
+    size_t index;
+    std::vector<size_t> candidates;
+  };
+
+  bool matches(const Query &query, const Level &parent) const;
+  void addValue(AggregateResult &result);
+
+  Tokenizer m_tokenizer;
+  Token m_token;
+  std::vector<Query> m_queries;
+  std::vector<size_t> m_all_queries;
+  std::vector<Level> m_levels;
+  size_t m_depth = 0;
+};
+
+inline size_t JsonAggregator::addQuery(const std::string &path)
+{
+  return addQuery(path, std::vector<double>());
+}
+
+inline size_t JsonAggregator::addQuery(const std::string &path, const std::vector<double> &histogram_bounds)
+{
+  if (path.size() && path[0] != '/')
+    return size_t(-1);
+  Internal::ExtractPath parsed;
+  Internal::parseExtractPath(path, parsed);
+  Query query;
+  query.segments = std::move(parsed.segments);
+  query.indices = std::move(parsed.indices);
+  query.result.bounds = histogram_bounds;
+  std::sort(query.result.bounds.begin(), query.result.bounds.end());
+  if (query.result.bounds.size())
+    query.result.histogram.resize(query.result.bounds.size() + 1);
+  m_queries.push_back(std::move(query));
+  m_all_queries.push_back(m_queries.size() - 1);
+  return m_queries.size() - 1;
+}
+
+inline void JsonAggregator::addData(const char *data, size_t size)
+{
+  m_tokenizer.addData(data, size);
+}
+
+inline const AggregateResult &JsonAggregator::result(size_t query) const
+{
+  return m_queries[query].result;
+}
+
+inline std::string JsonAggregator::makeErrorString() const
+{
+  return m_tokenizer.makeErrorString();
+}
+
+inline bool JsonAggregator::matches(const Query &query, const Level &parent) const
+{
+  const std::string &segment = query.segments[m_depth - 1];
+  if (segment.size() == 1 && segment[0] == '*')
+    return true;
+  if (parent.is_object)
+    return Internal::isJsonStringEqual(m_token.name, segment.data(), segment.size());
+  return query.indices[m_depth - 1] == parent.index;
+}
+
+inline void JsonAggregator::addValue(AggregateResult &result)
+{
+  double value;
+  const char *end;
+  auto parsed = Internal::ft::to_double(m_token.value.data, m_token.value.size, value, end);
+  if (parsed != Internal::ft::parse_string_error::ok || end != m_token.value.data + m_token.value.size)
+    return;
+  result.count++;
+  result.sum += value;
+  result.min = std::min(result.min, value);
+  result.max = std::max(result.max, value);
+  if (result.histogram.size())
+  {
+    size_t bin = size_t(std::upper_bound(result.bounds.begin(), result.bounds.end(), value) - result.bounds.begin());
+    result.histogram[bin]++;
+  }
+}
+
+inline Error JsonAggregator::process()
+{
+  while (true)
+  {
+    Error error = m_tokenizer.nextToken(m_token);
+    if (error == Error::NeedMoreData && m_depth == 0)
+      return Error::NoError;
+    if (error != Error::NoError)
+      return error;
+
+    if (m_token.value_type == Type::ObjectEnd || m_token.value_type == Type::ArrayEnd)
+    {
+      m_depth--;
+      continue;
+    }
+
+    const bool is_container = m_token.value_type == Type::ObjectStart || m_token.value_type == Type::ArrayStart;
+    if (is_container && m_levels.size() == m_depth)
+      m_levels.emplace_back();
+    Level *level = is_container ? &m_levels[m_depth] : nullptr;
+    if (level)
+    {
+      level->is_object = m_token.value_type == Type::ObjectStart;
+      level->index = 0;
+      level->candidates.clear();
+    }
+
+    const Level *parent = m_depth ? &m_levels[m_depth - 1] : nullptr;
+    const std::vector<size_t> &candidates = parent ? parent->candidates : m_all_queries;
+    for (size_t candidate : candidates)
+    {
+      Query &query = m_queries[candidate];
+      if (parent && !matches(query, *parent))
+        continue;
+      if (query.segments.size() > m_depth)
+      {
+        if (level)
+          level->candidates.push_back(candidate);
+      }
+      else if (m_token.value_type == Type::Number)
+      {
+        addValue(query.result);
+      }
+    }
+
+    if (parent)
+      m_levels[m_depth - 1].index++;
+    if (level)
+      m_depth++;
+  }
+}
+
+/*! \brief Sidecar index from element number to byte offset for a JSON document that is one large array.
+ *
+ *  build() records the offset of every \p stride element in one tokenizer pass. The index can be persisted with
+ *  save() and load(), and later runs can parse element k directly from the original buffer, for instance a memory
+ *  mapped file, by starting at the closest recorded offset and skipping at most stride - 1 elements. The persisted
+ *  form uses native byte order and remembers the size of the document it was built for.
+ */
+class JsonArrayIndex
+{
+public:
+  JsonArrayIndex()
+    : m_count(0)
+    , m_stride(1)
+    , m_json_size(0)
+  {
+  }
+
+  Error build(const char *json, size_t size, size_t stride = 1);
+
+  size_t size() const
+  {
+    return size_t(m_count);
+  }
+  size_t stride() const
+  {
+    return size_t(m_stride);
+  }
+  uint64_t jsonSize() const
+  {
+    return m_json_size;
+  }
+
+  /*! Sets \p element to the text of element \p index in \p json, which has to be the document the index was built
+   * for. */
+  Error elementRange(const char *json, size_t size, size_t index, DataRef &element) const;
+
+  template <typename T>
+  Error parseElement(const char *json, size_t size, size_t index, T &to_type) const
+  {
+    ParseContext context;
+    Error error = seek(json, size, index, context);
+    if (error != Error::NoError)
+      return error;
+    return TypeHandler<T>::to(to_type, context);
+  }
+
+  std::string serialize() const;
+  bool deserialize(const char *data, size_t size);
+  bool save(const std::string &path) const;
+  bool load(const std::string &path);
+
+private:
+  Error seek(const char *json, size_t size, size_t index, ParseContext &context) const;
+
+  std::vector<uint64_t> m_offsets;
+  uint64_t m_count;
+  uint64_t m_stride;
+  uint64_t m_json_size;
+};
+
+namespace Internal
+{
+inline void appendIndexValue(std::string &out, uint64_t value)
+{
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+inline bool readIndexValue(const char *&data, const char *end, uint64_t &value)
+{
+  if (size_t(end - data) < sizeof(value))
+    return false;
+  memcpy(&value, data, sizeof(value));
+  data += sizeof(value);
+  return true;
+}
+
+static const char json_array_index_magic[8] = {'J', 'S', 'A', 'I', 'D', 'X', '0', '1'};
+} // namespace Internal
+
+inline Error JsonArrayIndex::build(const char *json, size_t size, size_t stride)
+{
+  m_offsets.clear();
+  m_count = 0;
+  m_stride = stride ? stride : 1;
+  m_json_size = size;
+
+  Tokenizer tokenizer;
+  tokenizer.addData(json, size);
+  Token token;
+  Error error = tokenizer.nextToken(token);
+  if (error != Error::NoError)
+    return error;
+  if (token.value_type != Type::ArrayStart)
+    return Error::ExpectedArrayStart;
+
+  while (true)
+  {
+    error = tokenizer.nextToken(token);
+    if (error != Error::NoError)
+      return error;
+    if (token.value_type == Type::ArrayEnd)
+      return Error::NoError;
+    if (m_count % m_stride == 0)
+    {
+      const char *start = token.value.data - (token.value_type == Type::String ? 1 : 0);
+      m_offsets.push_back(uint64_t(start - json));
+    }
+    m_count++;
+    if (token.value_type == Type::ObjectStart || token.value_type == Type::ArrayStart)
+    {
+      error = Internal::skipJsonContainer(tokenizer, token);
+      if (error != Error::NoError)
+        return error;
+    }
+  }
+}
+
+inline Error JsonArrayIndex::seek(const char *json, size_t size, size_t index, ParseContext &context) const
+{
+  if (index >= m_count || size != m_json_size)
+    return Error::NodeNotFound;
+  // The tokenizer only accepts an object or an array as the root, so the elements from the recorded offset onwards
+  // are read as the items of an array that is opened in front of them.
+  const uint64_t offset = m_offsets[size_t(index / m_stride)];
+  if (offset >= size)
+    return Error::NodeNotFound;
+  const char *start = json + offset;
+  context.tokenizer.addData("[", 1);
+  context.tokenizer.addData(start, size_t(json + size - start));
+  if (context.nextToken() != Error::NoError)
+    return context.error;
+  for (size_t skip = size_t(index % m_stride);; skip--)
+  {
+    if (context.nextToken() != Error::NoError)
+      return context.error;
+    if (!skip)
+      return Error::NoError;
+    if (context.token.value_type == Type::ObjectStart || context.token.value_type == Type::ArrayStart)
+    {
+      Error error = Internal::skipJsonContainer(context.tokenizer, context.token);
+      if (error != Error::NoError)
+        return error;
+    }
+  }
+}
+
+inline Error JsonArrayIndex::elementRange(const char *json, size_t size, size_t index, DataRef &element) const
+{
+  ParseContext context;
+  Error error = seek(json, size, index, context);
+  if (error != Error::NoError)
+    return error;
+  const bool is_string = context.token.value_type == Type::String;
+  const char *start = context.token.value.data - (is_string ? 1 : 0);
+  if (context.token.value_type == Type::ObjectStart || context.token.value_type == Type::ArrayStart)
+  {
+    error = Internal::skipJsonContainer(context.tokenizer, context.token);
+    if (error != Error::NoError)
+      return error;
+  }
+  element = DataRef(start, size_t(context.token.value.data + context.token.value.size + (is_string ? 1 : 0) - start));
+  return Error::NoError;
+}
+
+inline std::string JsonArrayIndex::serialize() const
+{
+  std::string out(Internal::json_array_index_magic, sizeof(Internal::json_array_index_magic));
+  Internal::appendIndexValue(out, m_count);
+  Internal::appendIndexValue(out, m_stride);
+  Internal::appendIndexValue(out, m_json_size);
+  for (uint64_t offset : m_offsets)
+    Internal::appendIndexValue(out, offset);
+  return out;
+}
+
+inline bool JsonArrayIndex::deserialize(const char *data, size_t size)
+{
+  const char *end = data + size;
+  if (size < sizeof(Internal::json_array_index_magic) ||
+      memcmp(data, Internal::json_array_index_magic, sizeof(Internal::json_array_index_magic)) != 0)
+    return false;
+  data += sizeof(Internal::json_array_index_magic);
+  uint64_t count, stride, json_size;
+  if (!Internal::readIndexValue(data, end, count) || !Internal::readIndexValue(data, end, stride) ||
+      !Internal::readIndexValue(data, end, json_size) || stride == 0 || json_size > uint64_t(SIZE_MAX))
+    return false;
+  const uint64_t offset_count = count / stride + (count % stride ? 1 : 0);
+  if (offset_count > uint64_t(SIZE_MAX / sizeof(uint64_t)) || uint64_t(end - data) != offset_count * sizeof(uint64_t))
+    return false;
+
+  // Every offset has to point into the document, after the one before it, so seek() never leaves the buffer.
+  std::vector<uint64_t> offsets(static_cast<size_t>(offset_count));
+  for (size_t i = 0; i < offsets.size(); i++)
+  {
+    Internal::readIndexValue(data, end, offsets[i]);
+    if (offsets[i] >= json_size || (i && offsets[i] <= offsets[i - 1]))
+      return false;
+  }
+  m_offsets.swap(offsets);
+  m_count = count;
+  m_stride = stride;
+  m_json_size = json_size;
+  return true;
+}
+
+inline bool JsonArrayIndex::save(const std::string &path) const
+{
+  std::string data = serialize();
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+  bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+  return fclose(file) == 0 && written;
+}
+
+inline bool JsonArrayIndex::load(const std::string &path)
+{
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file)
+    return false;
+  std::string data;
+  char buffer[4096];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    data.append(buffer, read);
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok && deserialize(data.data(), data.size());
+}
+
+/*! \brief Tape entry of a Document: one per value, 20 bytes.
+ *
+ *  The token offsets are relative to the start of the document text. For strings the value range excludes the quotes,
+ *  like Token, and for objects and arrays it covers the whole text of the container. skip is the number of entries in
+ *  the subtree of the value, including itself, so the next sibling is always skip entries further down the tape.
+ */
+struct DocumentEntry
+{
+  CompactToken token;
+  uint32_t skip;
+};
+
+/*! \brief Read only DOM stored as a tape of DocumentEntry in one contiguous vector.
+ *
+ *  The Document refers to the text it was parsed from, which has to outlive it and can be at most 4GB. Nothing is
+ *  decoded while building the tape; numbers and strings are converted when Value::parseTo is called on them.
+ */
+class Document
+{
+public:
+  /*! \brief Handle to a value on the tape of a Document. Handles are invalidated by Document::parse. */
+  class Value
+  {
+  public:
+    Value()
+      : m_document(nullptr)
+      , m_index(0)
+    {
+    }
+    Value(const Document *document, size_t index)
+      : m_document(document)
+      , m_index(index)
+    {
+    }
+
+    bool isValid() const
+    {
+      return m_document != nullptr;
+    }
+    /*! Type::Error for an invalid handle. */
+    Type type() const
+    {
+      return isValid() ? Type(entry().token.value_type) : Type::Error;
+    }
+    bool isObject() const
+    {
+      return isValid() && type() == Type::ObjectStart;
+    }
+    bool isArray() const
+    {
+      return isValid() && type() == Type::ArrayStart;
+    }
+    /*! The raw, still escaped, member name. */
+    DataRef name() const
+    {
+      if (!isValid())
+        return DataRef();
+      return DataRef(m_document->m_json + entry().token.name_offset, entry().token.name_size);
+    }
+    /*! The raw text of the value. */
+    DataRef text() const
+    {
+      if (!isValid())
+        return DataRef();
+      return DataRef(m_document->m_json + entry().token.value_offset, entry().token.value_size);
+    }
+
+    /*! Number of members or items, found by hopping over the children. */
+    size_t size() const;
+    Value firstChild() const;
+    Value nextSibling() const;
+    /*! Array item by index, found by hopping over the preceding items and their subtrees, so the cost is linear in
+     * index. Walk the items with firstChild() and nextSibling() to visit them all. */
+    Value operator[](size_t index) const;
+    Value operator[](int index) const
+    {
+      return index < 0 ? Value() : (*this)[size_t(index)];
+    }
+    /*! Object member by raw name. */
+    Value operator[](const std::string &name) const;
+    Value operator[](const char *name) const
+    {
+      return (*this)[std::string(name)];
+    }
+
+    /*! Converts the value with the TypeHandler of T. */
+    template <typename T>
+    Error parseTo(T &to_type) const;
+
+  private:
+    const DocumentEntry &entry() const
+    {
+      return m_document->m_tape[m_index];
+    }
+    size_t end() const
+    {
+      return m_index + entry().skip;
+    }
+    const Document *m_document;
+    size_t m_index;
+    size_t m_parent_end = 0;
+  };
+
+  Document()
+    : m_json(nullptr)
+  {
+  }
+
+  Error parse(const char *json, size_t size);
+  Error parse(const std::string &json)
+  {
+    return parse(json.data(), json.size());
+  }
+
+  Value root() const
+  {
+    return m_tape.empty() ? Value() : Value(this, 0);
+  }
+  const std::vector<DocumentEntry> &tape() const
+  {
+    return m_tape;
+  }
+
+private:
+  const char *m_json;
+  std::vector<DocumentEntry> m_tape;
+};
+
+inline Error Document::parse(const char *json, size_t size)
+{
+  m_json = json;
+  m_tape.clear();
+  Tokenizer tokenizer;
+  tokenizer.addData(json, size);
+  std::vector<size_t> open;
+  Token token;
+  Error error = Error::NoError;
+  do
+  {
+    error = tokenizer.nextToken(token);
+    if (error != Error::NoError)
+      break;
+    if (token.value_type == Type::ObjectEnd || token.value_type == Type::ArrayEnd)
+    {
+      DocumentEntry &container = m_tape[open.back()];
+      container.skip = uint32_t(m_tape.size() - open.back());
+      container.token.value_size =
+        uint32_t(token.value.data + token.value.size - (json + container.token.value_offset));
+      open.pop_back();
+      continue;
+    }
+
+    DocumentEntry entry;
+    if (!Internal::packCompactToken(json, token, entry.token))
+      return Error::TooLarge;
+    entry.skip = 1;
+    if (token.value_type == Type::ObjectStart || token.value_type == Type::ArrayStart)
+      open.push_back(m_tape.size());
+    m_tape.push_back(entry);
+  } while (open.size());
+
+  if (error != Error::NoError)
+    m_tape.clear();
+  return error;
+}
+
+inline size_t Document::Value::size() const
+{
+  size_t count = 0;
+  for (Value child = firstChild(); child.isValid(); child = child.nextSibling())
+    count++;
+  return count;
+}
+
+inline Document::Value Document::Value::firstChild() const
+{
+  if (!isValid() || entry().skip < 2)
+    return Value();
+  Value child(m_document, m_index + 1);
+  child.m_parent_end = end();
+  return child;
+}
+
+inline Document::Value Document::Value::nextSibling() const
+{
+  if (!isValid() || end() >= m_parent_end)
+    return Value();
+  Value sibling(m_document, end());
+  sibling.m_parent_end = m_parent_end;
+  return sibling;
+}
+
+inline Document::Value Document::Value::operator[](size_t index) const
+{
+  if (!isArray())
+    return Value();
+  Value child = firstChild();
+  for (size_t i = 0; i < index && child.isValid(); i++)
+    child = child.nextSibling();
+  return child;
+}
+
+inline Document::Value Document::Value::operator[](const std::string &name) const
+{
+  if (!isObject())
+    return Value();
+  for (Value child = firstChild(); child.isValid(); child = child.nextSibling())
+  {
+    DataRef child_name = child.name();
+    if (child_name.size == name.size() && memcmp(child_name.data, name.data(), name.size()) == 0)
+      return child;
+  }
+  return Value();
+}
+
+template <typename T>
+Error Document::Value::parseTo(T &to_type) const
+{
+  if (!isValid())
+    return Error::NodeNotFound;
+  if (isObject() || isArray())
+  {
+    DataRef value = text();
+    ParseContext context(value.data, value.size);
+    return context.parseTo(to_type);
+  }
+  // Scalar TypeHandlers only look at the current token
+  ParseContext context;
+  context.token = Internal::unpackCompactToken(m_document->m_json, entry().token);
+  return TypeHandler<T>::to(to_type, context);
+}
+
+/*! \brief Bump allocator owning the nodes and strings of JS::Value trees.
+ *
+ *  Nothing is released before the arena is cleared or destroyed, so replacing parts of a tree leaves the old nodes
+ *  behind until then. Blocks start small and double in size, and clearing keeps the most recent block around for the
+ *  next document.
+ */
+class ValueArena
+{
+public:
+  ValueArena()
+    : m_current(nullptr)
+    , m_left(0)
+    , m_last_block_size(0)
+  {
+  }
+  ValueArena(const ValueArena &) = delete;
+  ValueArena &operator=(const ValueArena &) = delete;
+
+  /*! Returns size bytes aligned to 8 bytes. */
+  void *allocate(size_t size)
+  {
+    size = (size + 7) & ~size_t(7);
+    if (size > m_left)
+    {
+      size_t block_size = std::max(size, size_t(256) << std::min(m_blocks.size(), size_t(12)));
+      m_blocks.emplace_back(new char[block_size]);
+      m_current = m_blocks.back().get();
+      m_left = block_size;
+      m_last_block_size = block_size;
+    }
+    void *ret = m_current;
+    m_current += size;
+    m_left -= size;
+    return ret;
+  }
+
+  void clear()
+  {
+    if (m_blocks.empty())
+      return;
+    m_blocks.erase(m_blocks.begin(), m_blocks.end() - 1);
+    m_current = m_blocks.back().get();
+    m_left = m_last_block_size;
+  }
+
+private:
+  std::vector<std::unique_ptr<char[]>> m_blocks;
+  char *m_current;
+  size_t m_left;
+  size_t m_last_block_size;
+};
+
+namespace Internal
+{
+struct ValueMember;
+
+/* 16 bytes. Strings of up to 8 bytes are stored in short_string, longer ones in the arena. Arrays and objects point
+ * to an arena allocated run of capacity nodes or members. */
+struct ValueNode
+{
+  ValueNode()
+    : integer(0)
+    , size(0)
+    , capacity(0)
+    , type(uint32_t(Type::Null))
+    , is_integer(0)
+  {
+  }
+
+  union {
+    bool boolean;
+    int64_t integer;
+    double number;
+    const char *string;
+    char short_string[8];
+    ValueNode *items;
+    ValueMember *members;
+  };
+  uint32_t size;
+  uint32_t capacity : 27;
+  uint32_t type : 4;
+  uint32_t is_integer : 1;
+};
+
+struct ValueMember
+{
+  ValueNode name;
+  ValueNode value;
+};
+
+const size_t valueMaxContainerSize = (size_t(1) << 27) - 1;
+
+inline DataRef valueString(const ValueNode &node)
+{
+  return DataRef(node.size <= sizeof(node.short_string) ? node.short_string : node.string, node.size);
+}
+
+inline void setValueString(ValueArena &arena, ValueNode &node, const char *data, size_t size)
+{
+  node = ValueNode();
+  node.type = uint32_t(Type::String);
+  node.size = uint32_t(size);
+  if (size <= sizeof(node.short_string))
+  {
+    memcpy(node.short_string, data, size);
+    return;
+  }
+  char *string = static_cast<char *>(arena.allocate(size));
+  memcpy(string, data, size);
+  node.string = string;
+}
+
+inline void setValueStringToken(ValueArena &arena, ValueNode &node, const DataRef &raw, std::string &buffer)
+{
+  if (!memchr(raw.data, '\\', raw.size))
+  {
+    setValueString(arena, node, raw.data, raw.size);
+    return;
+  }
+  buffer.clear();
+  handle_json_escapes_in(raw, buffer);
+  setValueString(arena, node, buffer.data(), buffer.size());
+}
+
+template <typename T>
+inline T *allocateValueRun(ValueArena &arena, const T *from, size_t size)
+{
+  if (!size)
+    return nullptr;
+  T *run = static_cast<T *>(arena.allocate(size * sizeof(T)));
+  for (size_t i = 0; i < size; i++)
+    new (run + i) T(from[i]);
+  return run;
+}
+
+/* Children of the containers being parsed are collected here and copied into the arena, sized exactly, when the
+ * container ends. */
+struct ValueParseStack
+{
+  std::vector<ValueMember> members;
+  std::string buffer;
+};
+
+inline Error parseValueNode(ValueArena &arena, ValueNode &node, ParseContext &context, ValueParseStack &stack)
+{
+  node = ValueNode();
+  const Token &token = context.token;
+  switch (token.value_type)
+  {
+  case Type::Null:
+    return Error::NoError;
+  case Type::Bool:
+    node.type = uint32_t(Type::Bool);
+    return TypeHandler<bool>::to(node.boolean, context);
+  case Type::Number:
+  {
+    node.type = uint32_t(Type::Number);
+    const char *end = token.value.data + token.value.size;
+    const char *pointer;
+    // Integers that fit in 18 digits are kept exact, everything else goes through double
+    bool integer = token.value.size <= 18 + size_t(token.value.data[0] == '-');
+    for (size_t i = 0; integer && i < token.value.size; i++)
+      integer = token.value.data[i] != '.' && token.value.data[i] != 'e' && token.value.data[i] != 'E';
+    if (integer &&
+        ft::integer::to_integer(token.value.data, token.value.size, node.integer, pointer) ==
+          ft::parse_string_error::ok &&
+        pointer == end)
+    {
+      node.is_integer = 1;
+      return Error::NoError;
+    }
+    if (ft::to_double(token.value.data, token.value.size, node.number, pointer) != ft::parse_string_error::ok ||
+        pointer != end)
+      return Error::FailedToParseDouble;
+    return Error::NoError;
+  }
+  case Type::String:
+  case Type::Ascii:
+    setValueStringToken(arena, node, token.value, stack.buffer);
+    return Error::NoError;
+  case Type::ArrayStart:
+  case Type::ObjectStart:
+    break;
+  default:
+    return Error::IllegalDataValue;
+  }
+
+  bool object = token.value_type == Type::ObjectStart;
+  Type end = object ? Type::ObjectEnd : Type::ArrayEnd;
+  size_t mark = stack.members.size();
+  Error error = context.nextToken();
+  while (error == Error::NoError && context.token.value_type != end)
+  {
+    ValueMember member;
+    if (object)
+      setValueStringToken(arena, member.name, context.token.name, stack.buffer);
+    error = parseValueNode(arena, member.value, context, stack);
+    if (error != Error::NoError)
+      break;
+    stack.members.push_back(member);
+    error = context.nextToken();
+  }
+  size_t size = stack.members.size() - mark;
+  if (error == Error::NoError && size > valueMaxContainerSize)
+    error = Error::TooLarge;
+  if (error == Error::NoError)
+  {
+    node.type = uint32_t(object ? Type::ObjectStart : Type::ArrayStart);
+    node.size = uint32_t(size);
+    node.capacity = uint32_t(size);
+    if (object)
+    {
+      node.members = allocateValueRun(arena, stack.members.data() + mark, size);
+    }
+    else if (size)
+    {
+      node.items = static_cast<ValueNode *>(arena.allocate(size * sizeof(ValueNode)));
+      for (size_t i = 0; i < size; i++)
+        new (node.items + i) ValueNode(stack.members[mark + i].value);
+    }
+  }
+  stack.members.resize(mark);
+  return error;
+}
+
+inline void copyValueNode(ValueArena &arena, ValueNode &to, const ValueNode &from)
+{
+  to = from;
+  if (from.type == uint32_t(Type::String))
+  {
+    setValueString(arena, to, valueString(from).data, from.size);
+  }
+  else if (from.type == uint32_t(Type::ArrayStart))
+  {
+    to.capacity = from.size;
+    to.items = allocateValueRun(arena, from.items, from.size);
+    for (size_t i = 0; i < from.size; i++)
+      copyValueNode(arena, to.items[i], from.items[i]);
+  }
+  else if (from.type == uint32_t(Type::ObjectStart))
+  {
+    to.capacity = from.size;
+    to.members = allocateValueRun(arena, from.members, from.size);
+    for (size_t i = 0; i < from.size; i++)
+    {
+      copyValueNode(arena, to.members[i].name, from.members[i].name);
+      copyValueNode(arena, to.members[i].value, from.members[i].value);
+    }
+  }
+}
+
+/* Makes room for one more child, doubling the capacity. The old run is left in the arena. */
+template <typename T>
+inline T *growValueRun(ValueArena &arena, T *run, ValueNode &node)
+{
+  if (node.size < node.capacity)
+    return run;
+  size_t capacity = node.capacity ? std::min(size_t(node.capacity) * 2, valueMaxContainerSize) : 4;
+  T *grown = static_cast<T *>(arena.allocate(capacity * sizeof(T)));
+  for (size_t i = 0; i < node.size; i++)
+    new (grown + i) T(run[i]);
+  node.capacity = uint32_t(capacity);
+  return grown;
+}
+
+inline void serializeValueNode(const ValueNode &node, Token &token, Serializer &serializer)
+{
+  switch (Type(node.type))
+  {
+  case Type::Bool:
+    TypeHandler<bool>::from(node.boolean, token, serializer);
+    break;
+  case Type::Number:
+    if (node.is_integer)
+      TypeHandler<int64_t>::from(node.integer, token, serializer);
+    else
+      TypeHandler<double>::from(node.number, token, serializer);
+    break;
+  case Type::String:
+  {
+    std::string buffer;
+    DataRef string = valueString(node);
+    token.value_type = Type::String;
+    token.value = handle_json_escapes_out(string.data, string.size, buffer);
+    serializer.write(token);
+    break;
+  }
+  case Type::ArrayStart:
+    token.value_type = Type::ArrayStart;
+    token.value = DataRef("[");
+    serializer.write(token);
+    token.name = DataRef();
+    for (size_t i = 0; i < node.size; i++)
+      serializeValueNode(node.items[i], token, serializer);
+    token.name = DataRef();
+    token.value_type = Type::ArrayEnd;
+    token.value = DataRef("]");
+    serializer.write(token);
+    break;
+  case Type::ObjectStart:
+    token.value_type = Type::ObjectStart;
+    token.value = DataRef("{");
+    serializer.write(token);
+    for (size_t i = 0; i < node.size; i++)
+    {
+      std::string buffer;
+      DataRef name = valueString(node.members[i].name);
+      token.name = handle_json_escapes_out(name.data, name.size, buffer);
+      token.name_type = Type::String;
+      serializeValueNode(node.members[i].value, token, serializer);
+    }
+    token.name = DataRef();
+    token.name_type = Type::String;
+    token.value_type = Type::ObjectEnd;
+    token.value = DataRef("}");
+    serializer.write(token);
+    break;
+  default:
+    token.value_type = Type::Null;
+    token.value = DataRef("null");
+    serializer.write(token);
+    break;
+  }
+}
+} // namespace Internal
+
+/*! \brief Non owning handle to a node in a JS::Value tree.
+ *
+ *  Handles to array items and object members are invalidated when their container grows or is replaced.
+ */
+class ValueRef
+{
+public:
+  ValueRef()
+    : m_arena(nullptr)
+    , m_owner(nullptr)
+    , m_node(nullptr)
+  {
+  }
+  ValueRef(ValueArena *arena, Internal::ValueNode *node)
+    : m_arena(arena)
+    , m_owner(nullptr)
+    , m_node(node)
+  {
+  }
+
+  bool isValid() const
+  {
+    return m_node != nullptr;
+  }
+  /*! Null, Bool, Number, String, ArrayStart or ObjectStart, and Error for an invalid handle. */
+  Type type() const
+  {
+    return isValid() ? Type(m_node->type) : Type::Error;
+  }
+  bool isNull() const
+  {
+    return isValid() && type() == Type::Null;
+  }
+  bool isBool() const
+  {
+    return isValid() && type() == Type::Bool;
+  }
+  bool isNumber() const
+  {
+    return isValid() && type() == Type::Number;
+  }
+  /*! True for numbers that were parsed or set as a 64 bit integer. */
+  bool isInteger() const
+  {
+    return isNumber() && m_node->is_integer;
+  }
+  bool isString() const
+  {
+    return isValid() && type() == Type::String;
+  }
+  bool isArray() const
+  {
+    return isValid() && type() == Type::ArrayStart;
+  }
+  bool isObject() const
+  {
+    return isValid() && type() == Type::ObjectStart;
+  }
+
+  bool toBool() const
+  {
+    return isBool() && m_node->boolean;
+  }
+  int64_t toInt() const
+  {
+    if (!isNumber())
+      return 0;
+    return m_node->is_integer ? m_node->integer : int64_t(m_node->number);
+  }
+  double toDouble() const
+  {
+    if (!isNumber())
+      return 0.0;
+    return m_node->is_integer ? double(m_node->integer) : m_node->number;
+  }
+  /*! The unescaped string. Points into the arena, or into the node for short strings. */
+  DataRef string() const
+  {
+    return isString() ? Internal::valueString(*m_node) : DataRef();
+  }
+  std::string toString() const
+  {
+    DataRef ref = string();
+    return std::string(ref.data, ref.size);
+  }
+
+  /*! Number of items or members. */
+  size_t size() const
+  {
+    return isArray() || isObject() ? m_node->size : 0;
+  }
+  /*! Array item, or object member value, by index. */
+  ValueRef operator[](size_t index) const
+  {
+    if (index >= size())
+      return ValueRef();
+    if (isArray())
+      return ValueRef(currentArena(), m_node->items + index);
+    return ValueRef(currentArena(), &m_node->members[index].value);
+  }
+  ValueRef operator[](int index) const
+  {
+    return index < 0 ? ValueRef() : (*this)[size_t(index)];
+  }
+  /*! Unescaped name of the object member at index. */
+  DataRef name(size_t index) const
+  {
+    return isObject() && index < size() ? Internal::valueString(m_node->members[index].name) : DataRef();
+  }
+  /*! Object member by unescaped name. */
+  ValueRef operator[](const std::string &name) const
+  {
+    return find(name.data(), name.size());
+  }
+  ValueRef operator[](const char *name) const
+  {
+    return find(name, strlen(name));
+  }
+
+  void setNull()
+  {
+    *m_node = Internal::ValueNode();
+  }
+  void setBool(bool b)
+  {
+    setNull();
+    m_node->type = uint32_t(Type::Bool);
+    m_node->boolean = b;
+  }
+  void setInt(int64_t i)
+  {
+    setNull();
+    m_node->type = uint32_t(Type::Number);
+    m_node->is_integer = 1;
+    m_node->integer = i;
+  }
+  void setDouble(double d)
+  {
+    setNull();
+    m_node->type = uint32_t(Type::Number);
+    m_node->number = d;
+  }
+  void setString(const char *data, size_t size)
+  {
+    Internal::setValueString(arena(), *m_node, data, size);
+  }
+  void setString(const std::string &str)
+  {
+    setString(str.data(), str.size());
+  }
+  void setArray()
+  {
+    setNull();
+    m_node->type = uint32_t(Type::ArrayStart);
+  }
+  void setObject()
+  {
+    setNull();
+    m_node->type = uint32_t(Type::ObjectStart);
+  }
+  /*! Deep copies other into this node. */
+  void set(const ValueRef &other)
+  {
+    Internal::ValueNode copy;
+    Internal::copyValueNode(arena(), copy, *other.m_node);
+    *m_node = copy;
+  }
+
+  /*! Appends a null item, turning a null value into an array first. Returns an invalid handle for other types. */
+  ValueRef append();
+  /*! Returns the member called name, appending a null member if there is none. A null value is turned into an
+   *  object first. Returns an invalid handle for other types. */
+  ValueRef insert(const std::string &name);
+
+protected:
+  ValueRef find(const char *name, size_t size) const
+  {
+    if (!isObject())
+      return ValueRef();
+    for (size_t i = 0; i < m_node->size; i++)
+    {
+      DataRef member = Internal::valueString(m_node->members[i].name);
+      if (member.size == size && memcmp(member.data, name, size) == 0)
+        return ValueRef(currentArena(), &m_node->members[i].value);
+    }
+    return ValueRef();
+  }
+
+  // The root handle of a Value has no arena of its own and creates the one of the Value on first use.
+  ValueArena &arena()
+  {
+    if (m_arena)
+      return *m_arena;
+    if (!*m_owner)
+      m_owner->reset(new ValueArena());
+    return **m_owner;
+  }
+  ValueArena *currentArena() const
+  {
+    return m_arena ? m_arena : m_owner->get();
+  }
+
+  ValueArena *m_arena;
+  std::shared_ptr<ValueArena> *m_owner;
+  Internal::ValueNode *m_node;
+};
+
+inline ValueRef ValueRef::append()
+{
+  if (isNull())
+    setArray();
+  if (!isArray() || m_node->size == Internal::valueMaxContainerSize)
+    return ValueRef();
+  ValueArena &arena = this->arena();
+  m_node->items = Internal::growValueRun(arena, m_node->items, *m_node);
+  Internal::ValueNode *item = new (m_node->items + m_node->size) Internal::ValueNode();
+  m_node->size++;
+  return ValueRef(&arena, item);
+}
+
+inline ValueRef ValueRef::insert(const std::string &name)
+{
+  if (isNull())
+    setObject();
+  ValueRef existing = find(name.data(), name.size());
+  if (existing.isValid() || !isObject() || m_node->size == Internal::valueMaxContainerSize)
+    return existing;
+  ValueArena &arena = this->arena();
+  m_node->members = Internal::growValueRun(arena, m_node->members, *m_node);
+  Internal::ValueMember *member = new (m_node->members + m_node->size) Internal::ValueMember();
+  Internal::setValueString(arena, member->name, name.data(), name.size());
+  m_node->size++;
+  return ValueRef(&arena, &member->value);
+}
+
+/*! \brief Dynamically typed JSON value holding the arena its nodes are allocated from.
+ *
+ *  Unlike JsonObject and JsonArray the content is decoded once while parsing, so it can be inspected and modified
+ *  without going back to the text. The arena is created on first use, and all the Values parsed with one ParseContext,
+ *  like the items of a std::vector<Value>, share the arena of that context, which lives as long as any of them. Values
+ *  sharing an arena must not be modified from different threads at the same time. Copying a Value deep copies the
+ *  tree into a new arena.
+ */
+class Value : public ValueRef
+{
+public:
+  Value()
+  {
+    m_owner = &m_owned_arena;
+    m_node = &m_root;
+  }
+  Value(const Value &other)
+    : Value()
+  {
+    if (other.m_owned_arena)
+      Internal::copyValueNode(arena(), m_root, other.m_root);
+    else
+      m_root = other.m_root;
+  }
+  Value(Value &&other)
+    : Value()
+  {
+    std::swap(m_owned_arena, other.m_owned_arena);
+    std::swap(m_root, other.m_root);
+  }
+  Value &operator=(const Value &other)
+  {
+    if (this != &other)
+    {
+      Value copy(other);
+      *this = std::move(copy);
+    }
+    return *this;
+  }
+  Value &operator=(Value &&other)
+  {
+    std::swap(m_owned_arena, other.m_owned_arena);
+    std::swap(m_root, other.m_root);
+    return *this;
+  }
+
+  /*! Sets the value to null. The nodes are released when no other Value shares the arena. */
+  void clear()
+  {
+    m_root = Internal::ValueNode();
+    if (m_owned_arena.use_count() == 1)
+      m_owned_arena->clear();
+    else
+      m_owned_arena.reset();
+  }
+
+private:
+  friend struct TypeHandler<Value>;
+  std::shared_ptr<ValueArena> m_owned_arena;
+  Internal::ValueNode m_root;
+};
+
+/// \private
+template <>
+struct TypeHandler<Value>
+{
+  static inline Error to(Value &to_type, ParseContext &context)
+  {
+    to_type.clear();
+    // The first Value parsed with a context lends it its arena, when it is not shared, so reparsing into the same
+    // Value reuses the memory.
+    if (!context.value_arena)
+      context.value_arena = to_type.m_owned_arena ? to_type.m_owned_arena : std::make_shared<ValueArena>();
+    to_type.m_owned_arena = context.value_arena;
+    Internal::ValueParseStack stack;
+    return Internal::parseValueNode(*context.value_arena, to_type.m_root, context, stack);
+  }
+
+  static inline void from(const Value &from, Token &token, Serializer &serializer)
+  {
+    Internal::serializeValueNode(from.m_root, token, serializer);
+  }
+};
 } // namespace JS
 #endif // JSON_STRUCT_H
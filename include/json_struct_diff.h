@@ -33,14 +33,34 @@
 
 #include "json_struct.h"
 
+// Define JS_DIFF_THREADS before including this header to let DiffContext use several threads (see
+// DiffContext::threadCount). The program then has to link the platform thread library, ie. Threads::Threads in cmake
+// or -pthread. Without it everything runs on the calling thread.
+#ifdef JS_DIFF_THREADS
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#endif
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
 namespace JS {
 
 enum DiffFlags : unsigned char
 {
-    None,
-    FuzzyFloatComparison
+    None = 0,
+    FuzzyFloatComparison = 1,
+    AlignArrays = 2             // Align array items by content, reporting inserted and missing items instead of positional diffs.
+                                // Arrays too different to align within a fixed amount of work get positional diffs.
 };
 
+inline DiffFlags operator|(DiffFlags a, DiffFlags b)
+{
+    return DiffFlags(static_cast<unsigned char>(a) | static_cast<unsigned char>(b));
+}
+
 enum DiffType : int
 {
     NoDiff,             // Type and value are equal
@@ -58,7 +78,8 @@ enum DiffError : unsigned char
 {
     NoError,
     NoTokens,
-    EmptyString
+    EmptyString,
+    TooLarge
 };
 
 struct DiffOptions
@@ -71,12 +92,43 @@ struct DiffOptions
     {}
     DiffFlags flags = DiffFlags::FuzzyFloatComparison;
     double fuzzyEpsilon = 1e-6; // Used if (flags | FuzzyFloatComparison == true)
+    std::string arrayIdentityMember; // If set, arrays of objects that all have this member are matched on its value
 };
 
 namespace Internal
 {
     namespace Diff
     {
+        const unsigned int noMetaIndex = ~0u;
+
+        // Hashes the name of the token and its type, but not the value.
+        inline uint64_t hashMember(uint64_t hash, const Token &token)
+        {
+            hash = hashValue(hash, token.name.size);
+            hash = hashBytes(hash, token.name.data, token.name.size);
+            hash = hashValue(hash, static_cast<uint64_t>(token.name_type));
+            return hashValue(hash, static_cast<uint64_t>(token.value_type));
+        }
+
+        inline uint64_t hashToken(uint64_t hash, const Token &token)
+        {
+            hash = hashMember(hash, token);
+            hash = hashValue(hash, token.value.size);
+            return hashBytes(hash, token.value.data, token.value.size);
+        }
+
+        inline bool isDataEqual(const DataRef &a, const DataRef &b)
+        {
+            return a.size == b.size && (a.size == 0 || memcmp(a.data, b.data, a.size) == 0);
+        }
+
+        // Compares what hashToken hashes
+        inline bool isTokenEqual(const Token &a, const Token &b)
+        {
+            return a.name_type == b.name_type && a.value_type == b.value_type && isDataEqual(a.name, b.name)
+                && isDataEqual(a.value, b.value);
+        }
+
         inline bool isComplexValue(const Token &token)
         {
             return (token.value_type == Type::ObjectStart) || (token.value_type == Type::ArrayStart);
@@ -110,13 +162,20 @@ struct DiffTokens
         clear();
         tokens.data.reserve(50);
         generateTokens(json, size);
+        if (error != DiffError::NoError)
+            return;
         diffs.resize(tokens.data.size(), DiffType::NoDiff);
         meta = metaForTokens(tokens);
+        generateMetaIndex();
+        generateSubtreeHashes();
     }
 
     void invalidate()
     {
         missingMembers.clear();
+        missingArrayItems.clear();
+        missingArrayItemIndexes.clear();
+        movedArrayItems.clear();
         diffs.clear();
         error = DiffError::NoError;
         diff_count = 0;
@@ -127,8 +186,13 @@ struct DiffTokens
     {
         tokens.data.clear();
         missingMembers.clear();
+        missingArrayItems.clear();
+        missingArrayItemIndexes.clear();
+        movedArrayItems.clear();
         diffs.clear();
         meta.clear();
+        metaIndex.clear();
+        subtreeHashes.clear();
         error = DiffError::NoError;
         diff_count = 0;
     }
@@ -141,15 +205,18 @@ struct DiffTokens
             return;
         }
 
-        Tokenizer tokenizer;
+        StrictTokenizer tokenizer;
         tokenizer.addData(json, size);
         Token token;
         Error e = Error::NoError;
         while (e == Error::NoError)
         {
             e = tokenizer.nextToken(token);
-            if (e == Error::NoError)
-                tokens.data.emplace_back(token);
+            if (e == Error::NoError && !tokens.data.push_back(token))
+            {
+                error = DiffError::TooLarge;
+                return;
+            }
         }
         if (e == Error::NeedMoreData)
             error = DiffError::NoError;
@@ -157,19 +224,76 @@ struct DiffTokens
             error = DiffError::NoTokens;
     }
 
-    void skip(size_t *pos) const
+    void generateMetaIndex()
     {
-        assert(*pos < size());
-        if (Internal::Diff::isComplexValue(tokens.data[*pos]))
+        metaIndex.assign(tokens.data.size(), Internal::Diff::noMetaIndex);
+        for (size_t i = 0; i < meta.size(); i++)
+            metaIndex[meta[i].position] = static_cast<unsigned int>(i);
+    }
+
+    // Hashes the tokens of each complex value in order, excluding the name of the value itself. Equal hashes are
+    // confirmed token by token in isSubtreeEqual, after which diffing the subtrees can be skipped.
+    void generateSubtreeHashes()
+    {
+        subtreeHashes.assign(meta.size(), 0);
+        std::vector<std::pair<size_t, uint64_t>> open; // meta index and running hash
+        size_t metaPos = 0;
+        for (size_t i = 0; i < tokens.data.size(); i++)
         {
-            for (const auto &m : meta)
+            const Token &token = tokens.data[i];
+            if (Internal::Diff::isComplexValue(token))
             {
-                if (m.position == *pos)
+                const uint64_t hash = Internal::hashValue(Internal::hashSeed, static_cast<uint64_t>(token.value_type));
+                open.push_back(std::make_pair(metaPos++, hash));
+            }
+            else if (token.value_type == Type::ObjectEnd || token.value_type == Type::ArrayEnd)
+            {
+                if (open.empty())
+                    break;
+                const size_t closing = open.back().first;
+                const uint64_t hash = Internal::hashValue(open.back().second, static_cast<uint64_t>(token.value_type));
+                subtreeHashes[closing] = hash;
+                open.pop_back();
+                if (open.size())
                 {
-                    *pos += m.size;
-                    return;
+                    const Token &start = tokens.data[meta[closing].position];
+                    open.back().second = Internal::hashValue(Internal::Diff::hashMember(open.back().second, start), hash);
                 }
             }
+            else if (open.size())
+            {
+                open.back().second = Internal::Diff::hashToken(open.back().second, token);
+            }
+        }
+    }
+
+    bool isSubtreeEqual(size_t pos, const DiffTokens &other, size_t otherPos) const
+    {
+        size_t metaPos;
+        size_t otherMetaPos;
+        if (!getMetaPos(pos, &metaPos) || !other.getMetaPos(otherPos, &otherMetaPos))
+            return false;
+        const size_t count = meta[metaPos].size;
+        if (count != other.meta[otherMetaPos].size || subtreeHashes[metaPos] != other.subtreeHashes[otherMetaPos])
+            return false;
+        // Confirm the hash match so a collision can not hide a change. The name of the value itself is not part of it.
+        if (tokens.data[pos].value_type != other.tokens.data[otherPos].value_type)
+            return false;
+        for (size_t i = 1; i < count; i++)
+        {
+            if (!Internal::Diff::isTokenEqual(tokens.data[pos + i], other.tokens.data[otherPos + i]))
+                return false;
+        }
+        return true;
+    }
+
+    void skip(size_t *pos) const
+    {
+        assert(*pos < size());
+        size_t metaPos;
+        if (getMetaPos(*pos, &metaPos))
+        {
+            *pos += meta[metaPos].size;
         }
         else
         {
@@ -230,17 +354,10 @@ struct DiffTokens
 
     bool getMetaPos(size_t pos, size_t *outPos) const
     {
-        bool set = false;
-        for (size_t i = 0; i < meta.size(); i++)
-        {
-            if (meta[i].position == pos)
-            {
-                *outPos = i;
-                set = true;
-                break;
-            }
-        }
-        return set;
+        if (pos >= metaIndex.size() || metaIndex[pos] == Internal::Diff::noMetaIndex)
+            return false;
+        *outPos = metaIndex[pos];
+        return true;
     }
 
     void addMissingMembers(const size_t startPos, const DiffTokens& baseTokens, const size_t basePos)
@@ -338,6 +455,13 @@ struct DiffTokens
         }
     }
 
+    // Adds the item at basePos, with index baseIndex in its base array, as missing from the array at startPos.
+    void addMissingArrayItem(const size_t startPos, const DiffTokens& baseTokens, const size_t basePos, const size_t baseIndex)
+    {
+        missingArrayItemIndexes[startPos].push_back(baseIndex);
+        addMissingArrayItems(startPos, baseTokens, basePos);
+    }
+
     void addMissingArrayToken(const size_t pos, const Token& missingItem)
     {
         assert(pos < tokens.data.size());
@@ -399,11 +523,30 @@ struct DiffTokens
         return getMissingTokens(token, missingArrayItems);
     }
 
+    // The base indexes, in ascending order, of the items missing from the array at diff position pos, or nullptr.
+    const std::vector<size_t>* getMissingArrayItemIndexes(size_t pos) const
+    {
+        auto it = missingArrayItemIndexes.find(pos);
+        return it == missingArrayItemIndexes.end() ? nullptr : &it->second;
+    }
+
+    // The items of the array at diff position pos that were matched by identity and changed order, or nullptr.
+    const std::vector<std::pair<size_t, size_t>>* getMovedArrayItems(size_t pos) const
+    {
+        auto it = movedArrayItems.find(pos);
+        return it == movedArrayItems.end() ? nullptr : &it->second;
+    }
+
     JsonTokens tokens;
     std::vector<Internal::Diff::MissingTokens> missingMembers;
     std::vector<Internal::Diff::MissingTokens> missingArrayItems;
+    std::unordered_map<size_t, std::vector<size_t>> missingArrayItemIndexes; // By diff position of the array
+    // By diff position of the array, the diff position and base index of items matched by identity that changed order
+    std::unordered_map<size_t, std::vector<std::pair<size_t, size_t>>> movedArrayItems;
     std::vector<DiffType> diffs; // Equal length to tokens.data array, having diffs in the same order
     std::vector<JsonMeta> meta;
+    std::vector<unsigned int> metaIndex; // Equal length to tokens.data array, index into meta for complex tokens
+    std::vector<uint64_t> subtreeHashes; // Equal length to meta array
     DiffError error;
     size_t diff_count = 0;
 };
@@ -422,6 +565,40 @@ namespace Internal
                 && (strncmp(base.name.data, diff.name.data, base.name.size) == 0);
         }
 
+        // Objects with at least this many members in base and diff combined are matched by hashing member names.
+        const size_t hashMatchThreshold = 32;
+
+        struct MemberName
+        {
+            explicit MemberName(const Token &token)
+                : name(token.name)
+                , type(token.name_type)
+            {}
+
+            explicit MemberName(const DataRef &name, Type type)
+                : name(name)
+                , type(type)
+            {}
+
+            bool operator==(const MemberName &other) const
+            {
+                return (type == other.type)
+                    && (name.size == other.name.size)
+                    && (memcmp(name.data, other.name.data, name.size) == 0);
+            }
+
+            DataRef name;
+            Type type;
+        };
+
+        struct MemberNameHash
+        {
+            size_t operator()(const MemberName &member) const
+            {
+                return static_cast<size_t>(hashBytes(hashSeed, member.name.data, member.name.size));
+            }
+        };
+
         inline bool isSameValueType(const Token &base, const Token &diff)
         {
             return base.value_type == diff.value_type;
@@ -547,6 +724,46 @@ namespace Internal
             }
         }
 
+        // Same result as the nested loops in diffObjects, but matches members in O(n + m).
+        inline void diffObjectsHashed(const DiffTokens &base, const size_t basePos, DiffTokens &diff, const size_t diffPos, const DiffOptions &options)
+        {
+            std::unordered_map<MemberName, size_t, MemberNameHash> diffMembers;
+            diffMembers.reserve(diff.childCount(diffPos));
+            for (size_t dPos = diffPos + 1; diff.tokens.data[dPos].value_type != Type::ObjectEnd; diff.skip(&dPos))
+                diffMembers.emplace(MemberName(diff.tokens.data[dPos]), dPos); // The first member with a given name wins.
+
+            std::unordered_set<MemberName, MemberNameHash> baseMembers;
+            baseMembers.reserve(base.childCount(basePos));
+
+            // Diff members that exist in both objects and find members that are in base but not in diff.
+            for (size_t bPos = basePos + 1; base.tokens.data[bPos].value_type != Type::ObjectEnd; base.skip(&bPos))
+            {
+                const Token &baseToken = base.tokens.data[bPos];
+                const MemberName baseName(baseToken);
+                baseMembers.insert(baseName);
+                auto it = diffMembers.find(baseName);
+                if (it == diffMembers.end())
+                {
+                    // Did not find baseToken in diff: missing member.
+                    diff.addMissingMembers(diffPos, base, bPos);
+                    continue;
+                }
+
+                const size_t dPos = it->second;
+                if (isSameValueType(baseToken, diff.tokens.data[dPos]))
+                    diffObjectMember(base, bPos, diff, dPos, options);
+                else
+                    setStateForEntireToken(diff, dPos, DiffType::TypeDiff);
+            }
+
+            // Find members that are in diff but not in base.
+            for (size_t dPos = diffPos + 1; diff.tokens.data[dPos].value_type != Type::ObjectEnd; diff.skip(&dPos))
+            {
+                if (baseMembers.find(MemberName(diff.tokens.data[dPos])) == baseMembers.end())
+                    setStateForEntireToken(diff, dPos, DiffType::NewMember);
+            }
+        }
+
         inline void diffObjects(const DiffTokens &base, const size_t basePos, DiffTokens &diff, const size_t diffPos, const DiffOptions &options)
         {
             assert(base.tokens.data[basePos].value_type == Type::ObjectStart);
@@ -554,11 +771,20 @@ namespace Internal
             assert(basePos < base.tokens.data.size());
             assert(diffPos < diff.tokens.data.size());
 
+            if (base.isSubtreeEqual(basePos, diff, diffPos))
+                return;
+
             size_t bChildCount = base.childCount(basePos);
             size_t dChildCount = diff.childCount(diffPos);
             if (bChildCount == 0 && dChildCount == 0)
                 return;
 
+            if (bChildCount + dChildCount >= hashMatchThreshold)
+            {
+                diffObjectsHashed(base, basePos, diff, diffPos, options);
+                return;
+            }
+
             size_t bPos = basePos + 1;
             size_t dPos = diffPos + 1;
 
@@ -628,17 +854,471 @@ namespace Internal
             }
         }
 
+        struct AlignOp
+        {
+            enum Type : unsigned char
+            {
+                Equal,
+                Insert,
+                Delete
+            };
+            Type type;
+            size_t baseIndex;
+            size_t diffIndex;
+        };
+
+        // Linear space variant of Myers' O((N+M)D) shortest edit script. Each box is split on its middle snake and
+        // the halves are aligned recursively, so only two diagonal vectors and the path corners are kept. The work is
+        // capped, since it grows with the product of the array lengths when they have little in common.
+        template <typename Equal>
+        class SequenceAligner
+        {
+        public:
+            SequenceAligner(const Equal &equal, size_t budget)
+                : m_equal(equal)
+                , m_budget(budget)
+                , m_work(0)
+                , m_aborted(false)
+            {}
+
+            // Appends the ops for a[aBegin, aEnd) against b[bBegin, bEnd). Returns false, leaving ops untouched,
+            // when the budget runs out.
+            bool align(size_t aBegin, size_t aEnd, size_t bBegin, size_t bEnd, std::vector<AlignOp> &ops)
+            {
+                std::vector<Point> path;
+                const Point first = {int64_t(aBegin), int64_t(bBegin)};
+                const Point last = {int64_t(aEnd), int64_t(bEnd)};
+                if (!findPath(first.x, first.y, last.x, last.y, path) && m_aborted)
+                    return false;
+                path.push_back(last);
+
+                int64_t x = first.x;
+                int64_t y = first.y;
+                for (const Point &point : path)
+                {
+                    while (x < point.x || y < point.y)
+                    {
+                        if (x < point.x && y < point.y && m_equal(size_t(x), size_t(y)))
+                        {
+                            ops.push_back({AlignOp::Equal, size_t(x++), size_t(y++)});
+                        }
+                        else if (point.x - x > point.y - y)
+                        {
+                            ops.push_back({AlignOp::Delete, size_t(x++), size_t(y)});
+                        }
+                        else
+                        {
+                            ops.push_back({AlignOp::Insert, size_t(x), size_t(y++)});
+                        }
+                    }
+                }
+                return true;
+            }
+
+        private:
+            struct Point
+            {
+                int64_t x;
+                int64_t y;
+            };
+
+            bool equal(int64_t x, int64_t y)
+            {
+                m_work++;
+                return m_equal(size_t(x), size_t(y));
+            }
+
+            int64_t &forward(int64_t k)
+            {
+                return m_forward[size_t(m_offset + k)];
+            }
+
+            int64_t &backward(int64_t c)
+            {
+                return m_backward[size_t(m_offset + c)];
+            }
+
+            // Searches from both corners of the box until the paths overlap, returning the snake where they meet.
+            bool midSnake(int64_t left, int64_t top, int64_t right, int64_t bottom, Point &start, Point &finish)
+            {
+                const int64_t size = (right - left) + (bottom - top);
+                const int64_t delta = (right - left) - (bottom - top);
+                const int64_t max = (size + 1) / 2;
+                m_offset = max + 1;
+                m_forward.assign(size_t(2 * max + 3), 0);
+                m_backward.assign(size_t(2 * max + 3), 0);
+                forward(1) = left;
+                backward(1) = bottom;
+                for (int64_t d = 0; d <= max; d++)
+                {
+                    m_work += size_t(2 * d + 1);
+                    if (m_work > m_budget)
+                    {
+                        m_aborted = true;
+                        return false;
+                    }
+                    for (int64_t k = d; k >= -d; k -= 2)
+                    {
+                        int64_t px;
+                        int64_t x;
+                        if (k == -d || (k != d && forward(k - 1) < forward(k + 1)))
+                        {
+                            px = x = forward(k + 1);
+                        }
+                        else
+                        {
+                            px = forward(k - 1);
+                            x = px + 1;
+                        }
+                        int64_t y = top + (x - left) - k;
+                        const int64_t py = (d == 0 || x != px) ? y : y - 1;
+                        while (x < right && y < bottom && equal(x, y))
+                        {
+                            x++;
+                            y++;
+                        }
+                        forward(k) = x;
+                        const int64_t c = k - delta;
+                        if ((delta & 1) && c >= -(d - 1) && c <= d - 1 && y >= backward(c))
+                        {
+                            start = {px, py};
+                            finish = {x, y};
+                            return true;
+                        }
+                    }
+                    for (int64_t c = d; c >= -d; c -= 2)
+                    {
+                        int64_t py;
+                        int64_t y;
+                        if (c == -d || (c != d && backward(c - 1) > backward(c + 1)))
+                        {
+                            py = y = backward(c + 1);
+                        }
+                        else
+                        {
+                            py = backward(c - 1);
+                            y = py - 1;
+                        }
+                        const int64_t k = c + delta;
+                        int64_t x = left + (y - top) + k;
+                        const int64_t px = (d == 0 || y != py) ? x : x + 1;
+                        while (x > left && y > top && equal(x - 1, y - 1))
+                        {
+                            x--;
+                            y--;
+                        }
+                        backward(c) = y;
+                        if (!(delta & 1) && k >= -d && k <= d && x <= forward(k))
+                        {
+                            start = {x, y};
+                            finish = {px, py};
+                            return true;
+                        }
+                    }
+                }
+                return false;
+            }
+
+            // Appends the corners of the edit path through the box. Returns false for an empty box or when aborted.
+            bool findPath(int64_t left, int64_t top, int64_t right, int64_t bottom, std::vector<Point> &path)
+            {
+                if (left == right && top == bottom)
+                    return false;
+                if (left == right || top == bottom)
+                {
+                    path.push_back({left, top});
+                    path.push_back({right, bottom});
+                    return true;
+                }
+                Point start;
+                Point finish;
+                if (!midSnake(left, top, right, bottom, start, finish))
+                    return false;
+                if (!findPath(left, top, start.x, start.y, path))
+                {
+                    if (m_aborted)
+                        return false;
+                    path.push_back(start);
+                }
+                if (!findPath(finish.x, finish.y, right, bottom, path))
+                {
+                    if (m_aborted)
+                        return false;
+                    path.push_back(finish);
+                }
+                return true;
+            }
+
+            const Equal &m_equal;
+            size_t m_budget;
+            size_t m_work;
+            bool m_aborted;
+            int64_t m_offset = 0;
+            std::vector<int64_t> m_forward;
+            std::vector<int64_t> m_backward;
+        };
+
+        // Number of comparisons and diagonal steps spent aligning one array before falling back to positional diffs.
+        const size_t alignBudget = size_t(1) << 24;
+
+        inline size_t itemTokenCount(const DiffTokens &tokens, size_t pos)
+        {
+            size_t metaPos;
+            if (tokens.getMetaPos(pos, &metaPos))
+                return tokens.meta[metaPos].size;
+            return 1;
+        }
+
+        inline double numberValue(const DataRef &value)
+        {
+            double d = 0.0;
+            const char *end;
+            ft::to_double(value.data, value.size, d, end);
+            return d;
+        }
+
+        // With fuzzy float comparison numbers only add their type, so items equal within the tolerance share a key.
+        inline uint64_t itemKey(const DiffTokens &tokens, size_t pos, bool fuzzy)
+        {
+            size_t metaPos;
+            if (!fuzzy)
+            {
+                if (tokens.getMetaPos(pos, &metaPos))
+                    return hashValue(tokens.subtreeHashes[metaPos], tokens.meta[metaPos].size);
+                return hashToken(hashSeed, tokens.tokens.data[pos]);
+            }
+            uint64_t hash = hashSeed;
+            const size_t count = itemTokenCount(tokens, pos);
+            for (size_t i = 0; i < count; i++)
+            {
+                const Token token = tokens.tokens.data[pos + i];
+                hash = token.value_type == Type::Number ? hashMember(hash, token) : hashToken(hash, token);
+            }
+            return hash;
+        }
+
+        inline bool itemsEqual(const DiffTokens &base, size_t bPos, const DiffTokens &diff, size_t dPos, const DiffOptions &options)
+        {
+            const size_t count = itemTokenCount(base, bPos);
+            if (count != itemTokenCount(diff, dPos))
+                return false;
+            const bool fuzzy = options.flags & DiffFlags::FuzzyFloatComparison;
+            for (size_t i = 0; i < count; i++)
+            {
+                const Token baseToken = base.tokens.data[bPos + i];
+                const Token diffToken = diff.tokens.data[dPos + i];
+                if (fuzzy && baseToken.value_type == Type::Number && diffToken.value_type == Type::Number)
+                {
+                    if (baseToken.name_type != diffToken.name_type || !isDataEqual(baseToken.name, diffToken.name)
+                        || !fuzzyEquals(numberValue(baseToken.value), numberValue(diffToken.value), options.fuzzyEpsilon))
+                        return false;
+                }
+                else if (!isTokenEqual(baseToken, diffToken))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        struct ArrayItems
+        {
+            std::vector<size_t> positions;
+            std::vector<uint64_t> keys;
+        };
+
+        inline void arrayItems(const DiffTokens &tokens, size_t arrayPos, bool fuzzy, ArrayItems &items)
+        {
+            for (size_t pos = arrayPos + 1; tokens.tokens.data[pos].value_type != Type::ArrayEnd; tokens.skip(&pos))
+            {
+                items.positions.push_back(pos);
+                items.keys.push_back(itemKey(tokens, pos, fuzzy));
+            }
+        }
+
+        struct ArrayItemsEqual
+        {
+            bool operator()(size_t baseIndex, size_t diffIndex) const
+            {
+                return baseItems.keys[baseIndex] == diffItems.keys[diffIndex]
+                    && itemsEqual(base, baseItems.positions[baseIndex], diff, diffItems.positions[diffIndex], options);
+            }
+            const DiffTokens &base;
+            const ArrayItems &baseItems;
+            const DiffTokens &diff;
+            const ArrayItems &diffItems;
+            const DiffOptions &options;
+        };
+
+        // Aligns the array items on their content, so inserting or removing an item only reports that item. Items
+        // are compared with the same float tolerance as positional diffs. Returns false, without touching diff, when
+        // the arrays are too different to align within alignBudget.
+        inline bool diffArraysAligned(const DiffTokens &base, const size_t basePos, DiffTokens &diff, const size_t diffPos, const DiffOptions &options)
+        {
+            const bool fuzzy = options.flags & DiffFlags::FuzzyFloatComparison;
+            ArrayItems baseItems;
+            ArrayItems diffItems;
+            arrayItems(base, basePos, fuzzy, baseItems);
+            arrayItems(diff, diffPos, fuzzy, diffItems);
+            const size_t n = baseItems.positions.size();
+            const size_t m = diffItems.positions.size();
+            const ArrayItemsEqual equal = {base, baseItems, diff, diffItems, options};
+
+            size_t prefix = 0;
+            while (prefix < n && prefix < m && equal(prefix, prefix))
+                prefix++;
+            size_t suffix = 0;
+            while (suffix < n - prefix && suffix < m - prefix && equal(n - 1 - suffix, m - 1 - suffix))
+                suffix++;
+
+            std::vector<AlignOp> ops;
+            SequenceAligner<ArrayItemsEqual> aligner(equal, alignBudget);
+            if (!aligner.align(prefix, n - suffix, prefix, m - suffix, ops))
+                return false;
+
+            for (const AlignOp &op : ops)
+            {
+                if (op.type == AlignOp::Delete)
+                    diff.addMissingArrayItem(diffPos, base, baseItems.positions[op.baseIndex], op.baseIndex);
+                else if (op.type == AlignOp::Insert)
+                    setStateForEntireToken(diff, diffItems.positions[op.diffIndex], DiffType::NewArrayItem);
+                // Equal items are equal, or equal within the float tolerance, so they keep their NoDiff state.
+            }
+            return true;
+        }
+
+        // Finds the value of the identity member of the object at pos. Only scalar values can be used as identity.
+        inline bool identityValue(const DiffTokens &tokens, size_t pos, const std::string &identityMember, MemberName *identity)
+        {
+            if (tokens.tokens.data[pos].value_type != Type::ObjectStart)
+                return false;
+            for (size_t member = pos + 1; tokens.tokens.data[member].value_type != Type::ObjectEnd; tokens.skip(&member))
+            {
+                const Token &token = tokens.tokens.data[member];
+                if (token.name.size == identityMember.size() && memcmp(token.name.data, identityMember.data(), token.name.size) == 0)
+                {
+                    if (isComplexValue(token))
+                        return false;
+                    *identity = MemberName(token.value, token.value_type);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Returns the indexes of a longest strictly increasing subsequence of values.
+        inline std::vector<size_t> longestIncreasingSubsequence(const std::vector<size_t> &values)
+        {
+            std::vector<size_t> tails; // index into values of the smallest tail of each subsequence length
+            std::vector<size_t> previous(values.size());
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                auto it = std::lower_bound(tails.begin(), tails.end(), values[i],
+                    [&values](size_t index, size_t value) { return values[index] < value; });
+                previous[i] = it == tails.begin() ? i : *(it - 1);
+                if (it == tails.end())
+                    tails.push_back(i);
+                else
+                    *it = i;
+            }
+            std::vector<size_t> result(tails.size());
+            size_t index = tails.empty() ? 0 : tails.back();
+            for (size_t i = result.size(); i > 0; i--)
+            {
+                result[i - 1] = index;
+                index = previous[index];
+            }
+            return result;
+        }
+
+        // Matches array items on the value of options.arrayIdentityMember. Returns false, without touching diff,
+        // if any item in either array is not an object with a scalar identity member.
+        inline bool diffArraysByIdentity(const DiffTokens &base, const size_t basePos, DiffTokens &diff, const size_t diffPos, const DiffOptions &options)
+        {
+            std::unordered_map<MemberName, size_t, MemberNameHash> baseItems;
+            std::vector<size_t> bPositions;
+            for (size_t bPos = basePos + 1; base.tokens.data[bPos].value_type != Type::ArrayEnd; base.skip(&bPos))
+            {
+                MemberName identity(DataRef(), Type::Error);
+                if (!identityValue(base, bPos, options.arrayIdentityMember, &identity))
+                    return false;
+                baseItems.emplace(identity, bPositions.size()); // The first item with a given identity wins.
+                bPositions.push_back(bPos);
+            }
+
+            std::vector<std::pair<size_t, size_t>> matched; // diff position and base index
+            std::vector<size_t> dPositions;
+            std::vector<bool> baseMatched(bPositions.size(), false);
+            std::vector<size_t> newItems;
+            for (size_t dPos = diffPos + 1; diff.tokens.data[dPos].value_type != Type::ArrayEnd; diff.skip(&dPos))
+            {
+                MemberName identity(DataRef(), Type::Error);
+                if (!identityValue(diff, dPos, options.arrayIdentityMember, &identity))
+                    return false;
+                auto it = baseItems.find(identity);
+                if (it == baseItems.end() || baseMatched[it->second])
+                {
+                    newItems.push_back(dPos);
+                    continue;
+                }
+                baseMatched[it->second] = true;
+                matched.push_back(std::make_pair(dPos, it->second));
+            }
+
+            for (size_t i = 0; i < bPositions.size(); i++)
+            {
+                if (!baseMatched[i])
+                    diff.addMissingArrayItem(diffPos, base, bPositions[i], i);
+            }
+            for (size_t dPos : newItems)
+                setStateForEntireToken(diff, dPos, DiffType::NewArrayItem);
+
+            // Items outside a longest run that kept its relative order are reported as moved.
+            std::vector<size_t> baseOrder;
+            baseOrder.reserve(matched.size());
+            for (const auto &m : matched)
+                baseOrder.push_back(m.second);
+            std::vector<bool> kept(matched.size(), false);
+            for (size_t index : longestIncreasingSubsequence(baseOrder))
+                kept[index] = true;
+
+            std::vector<std::pair<size_t, size_t>> moved;
+            for (size_t i = 0; i < matched.size(); i++)
+            {
+                const size_t dPos = matched[i].first;
+                diffObjects(base, bPositions[matched[i].second], diff, dPos, options);
+                if (!kept[i])
+                {
+                    moved.push_back(matched[i]);
+                    diff.diff_count++;
+                }
+            }
+            if (moved.size())
+                diff.movedArrayItems.emplace(diffPos, std::move(moved));
+            return true;
+        }
+
         inline void diffArrays(const DiffTokens &base, const size_t basePos, DiffTokens &diff, const size_t diffPos, const DiffOptions &options)
         {
             assert(base.tokens.data[basePos].value_type == Type::ArrayStart);
             assert(diff.tokens.data[diffPos].value_type == Type::ArrayStart);
 
+            if (base.isSubtreeEqual(basePos, diff, diffPos))
+                return;
+
             size_t bChildCount = base.childCount(basePos);
             size_t dChildCount = diff.childCount(diffPos);
             if (bChildCount == 0 && dChildCount == 0)
                 return;
 
+            if (options.arrayIdentityMember.size() && diffArraysByIdentity(base, basePos, diff, diffPos, options))
+                return;
+
+            if ((options.flags & DiffFlags::AlignArrays) && diffArraysAligned(base, basePos, diff, diffPos, options))
+                return;
+
             size_t bPos = basePos + 1;
+            size_t bIndex = 0;
             size_t dPos = diffPos + 1;
             bool arrayDiffDone = false;
 
@@ -677,6 +1357,7 @@ namespace Internal
                     }
 
                     base.skip(&bPos);
+                    bIndex++;
                     diff.skip(&dPos);
                 }
                 else
@@ -704,7 +1385,7 @@ namespace Internal
                             const Token bToken = base.tokens.data[bPos];
                             if (bToken.value_type == JS::Type::ArrayEnd)
                                 break;
-                            diff.addMissingArrayItems(diffPos, base, bPos);
+                            diff.addMissingArrayItem(diffPos, base, bPos, bIndex++);
                             base.skip(&bPos);
                         }
                         arrayDiffDone = true;
@@ -713,6 +1394,7 @@ namespace Internal
                     {
                         diff.set(dPos, DiffType::TypeDiff);
                         base.skip(&bPos);
+                        bIndex++;
                         diff.skip(&dPos);
                     }
                 }
@@ -747,8 +1429,8 @@ namespace Internal
             else
             {
                 diff.diff_count = 0;
-                const Type& baseType = base.tokens.data[0].value_type;
-                const Type& diffType = diff.tokens.data[0].value_type;
+                const Type baseType = base.tokens.data[0].value_type;
+                const Type diffType = diff.tokens.data[0].value_type;
                 if (baseType == diffType)
                 {
                     if (baseType == Type::ObjectStart)
@@ -767,13 +1449,67 @@ namespace Internal
     };
 }
 
-struct DiffContext
+namespace Internal
 {
-    explicit DiffContext(const DiffOptions &options = {})
-        : base()
-        , options(options)
-    {}
-
+    namespace Diff
+    {
+        // Calls function(i) for i in [0, count) on threadCount threads, including the calling thread. The first
+        // exception thrown by function stops the remaining work and is rethrown on the calling thread.
+        template <typename Function>
+        inline void parallelFor(size_t count, unsigned int threadCount, const Function &function)
+        {
+#ifdef JS_DIFF_THREADS
+            if (threadCount == 0)
+                threadCount = std::max(1u, std::thread::hardware_concurrency());
+            if (threadCount > count)
+                threadCount = static_cast<unsigned int>(count);
+            if (threadCount > 1)
+            {
+                std::atomic<size_t> next(0);
+                std::exception_ptr exception;
+                std::mutex exceptionMutex;
+                auto worker = [&next, count, &function, &exception, &exceptionMutex]()
+                {
+                    try
+                    {
+                        for (size_t i = next++; i < count; i = next++)
+                            function(i);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock(exceptionMutex);
+                        if (!exception)
+                            exception = std::current_exception();
+                        next = count;
+                    }
+                };
+                std::vector<std::thread> threads;
+                threads.reserve(threadCount - 1);
+                for (unsigned int i = 1; i < threadCount; i++)
+                    threads.emplace_back(worker);
+                worker();
+                for (auto &thread : threads)
+                    thread.join();
+                if (exception)
+                    std::rethrow_exception(exception);
+                return;
+            }
+#else
+            (void)threadCount;
+#endif
+            for (size_t i = 0; i < count; i++)
+                function(i);
+        }
+    }
+}
+
+struct DiffContext
+{
+    explicit DiffContext(const DiffOptions &options = {})
+        : base()
+        , options(options)
+    {}
+
     explicit DiffContext(const char* baseJson, size_t baseSize, const DiffOptions &options = {})
         : base(baseJson, baseSize)
         , options(options)
@@ -831,11 +1567,11 @@ struct DiffContext
     {
         options = opt;
         base.invalidate();
-        for (auto &diffTokens : diffs)
+        Internal::Diff::parallelFor(diffs.size(), threadCount, [this](size_t i)
         {
-            diffTokens.invalidate();
-            diff(diffTokens);
-        }
+            diffs[i].invalidate();
+            diff(diffs[i]);
+        });
     }
 
     void invalidate()
@@ -865,7 +1601,46 @@ struct DiffContext
         return diff(json, SIZE);
     }
 
-    void diff(DiffTokens &diffTokens)
+    // Tokenizes and diffs the documents on threadCount threads. Returns the position in diffs for each document,
+    // or size_t(-1) for documents that failed, in which case error holds the error of the last failed document.
+    std::vector<size_t> diff(const std::vector<DataRef> &jsons)
+    {
+        std::vector<DiffTokens> tokens(jsons.size());
+        Internal::Diff::parallelFor(jsons.size(), threadCount, [this, &jsons, &tokens](size_t i)
+        {
+            tokens[i].reset(jsons[i].data, jsons[i].size);
+            if (tokens[i].error == DiffError::NoError)
+                diff(tokens[i]);
+        });
+
+        error = DiffError::NoError;
+        std::vector<size_t> positions;
+        positions.reserve(jsons.size());
+        diffs.reserve(diffs.size() + jsons.size());
+        for (auto &diffTokens : tokens)
+        {
+            if (diffTokens.error != DiffError::NoError)
+            {
+                error = diffTokens.error;
+                positions.push_back(size_t(-1));
+                continue;
+            }
+            diffs.emplace_back(std::move(diffTokens));
+            positions.push_back(diffs.size() - 1);
+        }
+        return positions;
+    }
+
+    std::vector<size_t> diff(const std::vector<std::string> &jsons)
+    {
+        std::vector<DataRef> refs;
+        refs.reserve(jsons.size());
+        for (auto &json : jsons)
+            refs.push_back(DataRef(json));
+        return diff(refs);
+    }
+
+    void diff(DiffTokens &diffTokens) const
     {
         Internal::Diff::diff(base, diffTokens, options);
     }
@@ -874,7 +1649,883 @@ struct DiffContext
     std::vector<DiffTokens> diffs;
     DiffError error = DiffError::NoError;
     DiffOptions options;
+    unsigned int threadCount = 1; // Threads used by invalidate() and diff() of several documents, 0 uses all cores.
+                                  // Only honoured when JS_DIFF_THREADS is defined.
+};
+
+enum class PatchError : unsigned char
+{
+    NoError,
+    InvalidPatch,   // The patch is not an array of valid RFC 6902 operations
+    InvalidJson,    // The document to patch is not valid JSON
+    PathNotFound,   // A path or from pointer does not exist in the document
+    TestFailed      // The value of a test operation did not match
 };
 
+namespace Internal
+{
+    namespace Patch
+    {
+        const size_t npos = size_t(-1);
+
+        // The raw text of the value starting with token first and ending with token last.
+        inline DataRef valueRange(const Token &first, const Token &last)
+        {
+            const char *begin = first.value.data - (first.value_type == Type::String ? 1 : 0);
+            const char *end = last.value.data + last.value.size + (last.value_type == Type::String ? 1 : 0);
+            return DataRef(begin, size_t(end - begin));
+        }
+
+        // Pointers hold unescaped member names, so they have to be escaped to be written as JSON strings.
+        inline void appendPointer(std::string &patch, const std::string &pointer)
+        {
+            std::string buffer;
+            const DataRef escaped = Internal::handle_json_escapes_out(pointer, buffer);
+            patch.append(escaped.data, escaped.size);
+        }
+
+        inline void appendOperation(std::string &patch, const char *op, const std::string &path, const DataRef *value,
+                                    const std::string *from = nullptr)
+        {
+            if (patch.size() > 1)
+                patch += ',';
+            patch += "{\"op\":\"";
+            patch += op;
+            patch += "\",\"path\":\"";
+            appendPointer(patch, path);
+            patch += '"';
+            if (from)
+            {
+                patch += ",\"from\":\"";
+                appendPointer(patch, *from);
+                patch += '"';
+            }
+            if (value)
+            {
+                patch += ",\"value\":";
+                patch.append(value->data, value->size);
+            }
+            patch += '}';
+        }
+
+        inline DataRef diffValueRange(const DiffTokens &diff, size_t pos)
+        {
+            size_t end = pos;
+            diff.skip(&end);
+            return valueRange(diff.tokens.data[pos], diff.tokens.data[end - 1]);
+        }
+
+        inline void patchForValue(const DiffTokens &diff, size_t pos, std::string &path, std::string &patch);
+
+        inline void patchForObject(const DiffTokens &diff, size_t pos, std::string &path, std::string &patch)
+        {
+            const size_t pathSize = path.size();
+            for (size_t child = pos + 1; diff.tokens.data[child].value_type != Type::ObjectEnd; diff.skip(&child))
+            {
+                const Token &token = diff.tokens.data[child];
+                appendJsonPointerName(path, token.name);
+                if (diff.diffs[child] == DiffType::NewMember)
+                {
+                    const DataRef value = diffValueRange(diff, child);
+                    appendOperation(patch, "add", path, &value);
+                }
+                else
+                {
+                    patchForValue(diff, child, path, patch);
+                }
+                path.resize(pathSize);
+            }
+
+            const std::vector<Token> *missing = diff.getMissingMembers(diff.tokens.data[pos]);
+            if (!missing)
+                return;
+            int depth = 0;
+            for (const Token &token : *missing)
+            {
+                if (depth == 0)
+                {
+                    appendJsonPointerName(path, token.name);
+                    appendOperation(patch, "remove", path, nullptr);
+                    path.resize(pathSize);
+                }
+                if (token.value_type == Type::ObjectStart || token.value_type == Type::ArrayStart)
+                    depth++;
+                else if (token.value_type == Type::ObjectEnd || token.value_type == Type::ArrayEnd)
+                    depth--;
+            }
+        }
+
+        // Appends an operation on the array item at index of the array at path, moving it from index from if set.
+        inline void appendIndexOperation(std::string &patch, const char *op, std::string &path, size_t index, const size_t *from)
+        {
+            const size_t pathSize = path.size();
+            std::string fromPath;
+            if (from)
+                fromPath = path + '/' + std::to_string(*from);
+            path += '/';
+            path += std::to_string(index);
+            appendOperation(patch, op, path, nullptr, from ? &fromPath : nullptr);
+            path.resize(pathSize);
+        }
+
+        // Counts the occupied slots in front of a slot in O(log n).
+        struct SlotCounter
+        {
+            explicit SlotCounter(size_t size)
+                : tree(size + 1, 0)
+            {}
+            void add(size_t slot, int64_t value)
+            {
+                for (size_t i = slot + 1; i < tree.size(); i += i & (~i + 1))
+                    tree[i] += value;
+            }
+            size_t before(size_t slot) const
+            {
+                int64_t count = 0;
+                for (size_t i = slot; i > 0; i -= i & (~i + 1))
+                    count += tree[i];
+                return size_t(count);
+            }
+            std::vector<int64_t> tree;
+        };
+
+        // Writes the move operations that put the items left after removing the missing ones into diff order. Items
+        // that are not moved keep their relative order, so the array is split in gaps between them. Each gap holds
+        // the slots the moved items end up in, in diff order, followed by the slots they leave, in base order. Moving
+        // the items in diff order makes every position a count of the occupied slots in front of it.
+        inline void appendMoveOperations(const DiffTokens &diff, const std::vector<size_t> &items, const std::vector<size_t> *missing,
+                                         const std::vector<std::pair<size_t, size_t>> &moved, std::string &path, std::string &patch)
+        {
+            size_t baseCount = missing ? missing->size() : 0;
+            for (size_t item : items)
+            {
+                if (diff.diffs[item] != DiffType::NewArrayItem)
+                    baseCount++;
+            }
+            std::vector<bool> movedBase(baseCount, false);
+            for (const auto &m : moved)
+                movedBase[m.second] = true;
+
+            // Gap of the target slot of each moved item, in diff order.
+            std::vector<size_t> targetGap;
+            std::vector<size_t> targetCount(1, 0);
+            size_t next = 0;
+            for (size_t item : items)
+            {
+                if (diff.diffs[item] == DiffType::NewArrayItem)
+                    continue;
+                if (next < moved.size() && moved[next].first == item)
+                {
+                    targetGap.push_back(targetCount.size() - 1);
+                    targetCount.back()++;
+                    next++;
+                }
+                else
+                {
+                    targetCount.push_back(0);
+                }
+            }
+
+            // Gap of the source slot of each moved item, in base order.
+            std::vector<size_t> sourceGap(baseCount, 0);
+            std::vector<size_t> sourceCount(targetCount.size(), 0);
+            size_t gap = 0;
+            size_t nextMissing = 0;
+            for (size_t b = 0; b < baseCount; b++)
+            {
+                if (missing && nextMissing < missing->size() && (*missing)[nextMissing] == b)
+                {
+                    nextMissing++;
+                    continue;
+                }
+                if (movedBase[b])
+                {
+                    sourceGap[b] = gap;
+                    sourceCount[gap]++;
+                }
+                else
+                {
+                    gap++;
+                }
+            }
+
+            std::vector<size_t> gapStart(targetCount.size() + 1, 0);
+            for (size_t g = 0; g < targetCount.size(); g++)
+                gapStart[g + 1] = gapStart[g] + targetCount[g] + sourceCount[g] + 1;
+
+            SlotCounter slots(gapStart.back());
+            std::vector<size_t> sourceSlot(baseCount, 0);
+            std::vector<size_t> sourceUsed(sourceCount.size(), 0);
+            nextMissing = 0;
+            gap = 0;
+            for (size_t b = 0; b < baseCount; b++)
+            {
+                if (missing && nextMissing < missing->size() && (*missing)[nextMissing] == b)
+                {
+                    nextMissing++;
+                    continue;
+                }
+                if (movedBase[b])
+                {
+                    sourceSlot[b] = gapStart[gap] + targetCount[gap] + sourceUsed[gap]++;
+                    slots.add(sourceSlot[b], 1);
+                }
+                else
+                {
+                    slots.add(gapStart[gap + 1] - 1, 1);
+                    gap++;
+                }
+            }
+
+            std::vector<size_t> targetUsed(targetCount.size(), 0);
+            for (size_t i = 0; i < moved.size(); i++)
+            {
+                const size_t g = targetGap[i];
+                const size_t targetSlot = gapStart[g] + targetUsed[g]++;
+                const size_t from = slots.before(sourceSlot[moved[i].second]);
+                slots.add(sourceSlot[moved[i].second], -1);
+                const size_t to = slots.before(targetSlot);
+                slots.add(targetSlot, 1);
+                if (from != to)
+                    appendIndexOperation(patch, "move", path, to, &from);
+            }
+        }
+
+        // Arrays are patched by removing the missing items, highest index first, moving the items that changed
+        // order, and then adding new items and patching changed ones in diff order. If those operations take more
+        // space than the array itself, the array is replaced instead.
+        inline void patchForArray(const DiffTokens &diff, size_t pos, std::string &path, std::string &patch)
+        {
+            std::vector<size_t> items;
+            size_t length = 0;
+            for (size_t child = pos + 1; diff.tokens.data[child].value_type != Type::ArrayEnd; diff.skip(&child))
+            {
+                items.push_back(child);
+                if (diff.diffs[child] != DiffType::NewArrayItem)
+                    length++;
+            }
+
+            std::string operations = "[";
+            const std::vector<size_t> *missing = diff.getMissingArrayItemIndexes(pos);
+            if (missing)
+            {
+                for (auto it = missing->rbegin(); it != missing->rend(); ++it)
+                    appendIndexOperation(operations, "remove", path, *it, nullptr);
+            }
+            if (const std::vector<std::pair<size_t, size_t>> *moved = diff.getMovedArrayItems(pos))
+                appendMoveOperations(diff, items, missing, *moved, path, operations);
+
+            const size_t pathSize = path.size();
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                if (diff.diffs[items[i]] == DiffType::NewArrayItem)
+                {
+                    const DataRef value = diffValueRange(diff, items[i]);
+                    if (i == length)
+                        path += "/-";
+                    else
+                        path += '/' + std::to_string(i);
+                    appendOperation(operations, "add", path, &value);
+                    length++;
+                }
+                else
+                {
+                    path += '/';
+                    path += std::to_string(i);
+                    patchForValue(diff, items[i], path, operations);
+                }
+                path.resize(pathSize);
+            }
+
+            const DataRef value = diffValueRange(diff, pos);
+            const size_t replaceSize = sizeof("{\"op\":\"replace\",\"path\":\"\",\"value\":}") - 1 + path.size() + value.size;
+            if (operations.size() - 1 > replaceSize)
+            {
+                appendOperation(patch, "replace", path, &value);
+            }
+            else if (operations.size() > 1)
+            {
+                if (patch.size() > 1)
+                    patch += ',';
+                patch.append(operations, 1, std::string::npos);
+            }
+        }
+
+        inline void patchForValue(const DiffTokens &diff, size_t pos, std::string &path, std::string &patch)
+        {
+            const DiffType diffType = diff.diffs[pos];
+            const Type type = diff.tokens.data[pos].value_type;
+            if (diffType == DiffType::ValueDiff || diffType == DiffType::TypeDiff || diffType == DiffType::RootItemDiff
+                || diffType == DiffType::ErroneousRootItem || (pos == 0 && (diffType == DiffType::NewMember || diffType == DiffType::NewArrayItem)))
+            {
+                const DataRef value = diffValueRange(diff, pos);
+                appendOperation(patch, "replace", path, &value);
+            }
+            else if (type == Type::ObjectStart)
+            {
+                patchForObject(diff, pos, path, patch);
+            }
+            else if (type == Type::ArrayStart)
+            {
+                patchForArray(diff, pos, path, patch);
+            }
+        }
+
+        // An item of an object or array in a Tree. The text around the item is kept so the tree can be written
+        // back exactly as it was read.
+        struct TreeItem
+        {
+            DataRef prefix; // Separator and whitespace in front of the item
+            DataRef name;   // Raw member name, without quotes
+            DataRef colon;  // Text between the member name and the value
+            size_t value;
+        };
+
+        struct TreeNode
+        {
+            Type type;
+            DataRef text; // Text of a scalar, strings include their quotes
+            std::vector<TreeItem> items;
+            DataRef tail; // Text between the last item and the closing bracket
+        };
+
+        // The values of the document and the patch. Operations relink nodes and only touch the items of the parent
+        // they change, so the cost of an operation does not depend on the size of the document. The text of the
+        // nodes points into the document, the patch or strings owned by the tree.
+        struct Tree
+        {
+            // Adds the values of json, returning the root node or npos if json is not a single valid value.
+            size_t build(const char *json, size_t size, DataRef *leading, DataRef *trailing)
+            {
+                StrictTokenizer tokenizer;
+                tokenizer.addData(json, size);
+                std::vector<size_t> open;
+                const char *cursor = json;
+                size_t root = npos;
+                Token token;
+                Error error = Error::NoError;
+                while (true)
+                {
+                    error = tokenizer.nextToken(token);
+                    if (error != Error::NoError)
+                        break;
+                    const DataRef range = valueRange(token, token);
+                    if (token.value_type == Type::ObjectEnd || token.value_type == Type::ArrayEnd)
+                    {
+                        if (open.empty())
+                            return npos;
+                        nodes[open.back()].tail = DataRef(cursor, size_t(range.data - cursor));
+                        open.pop_back();
+                        cursor = range.data + range.size;
+                        continue;
+                    }
+                    if (open.empty() && root != npos)
+                        return npos;
+
+                    const size_t node = nodes.size();
+                    nodes.push_back(TreeNode());
+                    nodes[node].type = token.value_type;
+                    if (open.empty())
+                    {
+                        root = node;
+                        if (leading)
+                            *leading = DataRef(json, size_t(range.data - json));
+                    }
+                    else
+                    {
+                        TreeItem item;
+                        const char *start = range.data;
+                        if (nodes[open.back()].type == Type::ObjectStart)
+                        {
+                            start = token.name.data - 1;
+                            const char *nameEnd = token.name.data + token.name.size + 1;
+                            item.name = token.name;
+                            item.colon = DataRef(nameEnd, size_t(range.data - nameEnd));
+                        }
+                        item.prefix = DataRef(cursor, size_t(start - cursor));
+                        item.value = node;
+                        nodes[open.back()].items.push_back(item);
+                    }
+
+                    if (token.value_type == Type::ObjectStart || token.value_type == Type::ArrayStart)
+                    {
+                        open.push_back(node);
+                        cursor = range.data + 1;
+                    }
+                    else
+                    {
+                        nodes[node].text = range;
+                        cursor = range.data + range.size;
+                    }
+                }
+                if (error != Error::NeedMoreData || !open.empty() || root == npos)
+                    return npos;
+                if (trailing)
+                    *trailing = DataRef(cursor, size_t(json + size - cursor));
+                return root;
+            }
+
+            size_t copy(size_t node)
+            {
+                const size_t result = nodes.size();
+                TreeNode copied = nodes[node];
+                nodes.push_back(std::move(copied));
+                for (size_t i = 0; i < nodes[result].items.size(); i++)
+                {
+                    const size_t value = copy(nodes[result].items[i].value);
+                    nodes[result].items[i].value = value;
+                }
+                return result;
+            }
+
+            DataRef store(std::string text)
+            {
+                strings.push_back(std::move(text));
+                return DataRef(strings.back());
+            }
+
+            void write(size_t node, std::string &json) const
+            {
+                const TreeNode &n = nodes[node];
+                if (n.type != Type::ObjectStart && n.type != Type::ArrayStart)
+                {
+                    append(json, n.text);
+                    return;
+                }
+                const bool object = n.type == Type::ObjectStart;
+                json += object ? '{' : '[';
+                for (const TreeItem &item : n.items)
+                {
+                    append(json, item.prefix);
+                    if (object)
+                    {
+                        json += '"';
+                        append(json, item.name);
+                        json += '"';
+                        append(json, item.colon);
+                    }
+                    write(item.value, json);
+                }
+                append(json, n.tail);
+                json += object ? '}' : ']';
+            }
+
+            static void append(std::string &json, const DataRef &text)
+            {
+                if (text.size)
+                    json.append(text.data, text.size);
+            }
+
+            std::vector<TreeNode> nodes;
+            std::deque<std::string> strings;
+        };
+
+        inline DataRef stringContent(const TreeNode &node)
+        {
+            return DataRef(node.text.data + 1, node.text.size - 2);
+        }
+
+        inline bool isStringEqual(const DataRef &a, const DataRef &b)
+        {
+            if (Diff::isDataEqual(a, b))
+                return true;
+            if (!memchr(a.data, '\\', a.size))
+                return isJsonStringEqual(b, a.data, a.size);
+            std::string unescapedA;
+            Internal::handle_json_escapes_in(a, unescapedA);
+            return isJsonStringEqual(b, unescapedA.data(), unescapedA.size());
+        }
+
+        // Compares two values as JSON: members in any order, numbers by value and strings after unescaping.
+        inline bool isValueEqual(const Tree &tree, size_t a, size_t b)
+        {
+            const TreeNode &nodeA = tree.nodes[a];
+            const TreeNode &nodeB = tree.nodes[b];
+            if (nodeA.type != nodeB.type)
+                return false;
+            switch (nodeA.type)
+            {
+            case Type::Number:
+                return Diff::isDataEqual(nodeA.text, nodeB.text) || Diff::numberValue(nodeA.text) == Diff::numberValue(nodeB.text);
+            case Type::String:
+                return isStringEqual(stringContent(nodeA), stringContent(nodeB));
+            case Type::ArrayStart:
+                if (nodeA.items.size() != nodeB.items.size())
+                    return false;
+                for (size_t i = 0; i < nodeA.items.size(); i++)
+                {
+                    if (!isValueEqual(tree, nodeA.items[i].value, nodeB.items[i].value))
+                        return false;
+                }
+                return true;
+            case Type::ObjectStart:
+                if (nodeA.items.size() != nodeB.items.size())
+                    return false;
+                for (const TreeItem &itemA : nodeA.items)
+                {
+                    auto itemB = nodeB.items.begin();
+                    while (itemB != nodeB.items.end() && !isStringEqual(itemA.name, itemB->name))
+                        ++itemB;
+                    if (itemB == nodeB.items.end() || !isValueEqual(tree, itemA.value, itemB->value))
+                        return false;
+                }
+                return true;
+            default:
+                return Diff::isDataEqual(nodeA.text, nodeB.text);
+            }
+        }
+
+        struct TreeCursor
+        {
+            TreeCursor(const Tree &tree, size_t root)
+                : tree(tree)
+                , current(root)
+            {
+            }
+
+            Type type() const
+            {
+                return tree.nodes[current].type;
+            }
+
+            DataRef name() const
+            {
+                return tree.nodes[parent].items[index].name;
+            }
+
+            Error firstChild()
+            {
+                parent = current;
+                index = 0;
+                return enter();
+            }
+
+            Error nextSibling()
+            {
+                index++;
+                return enter();
+            }
+
+            Error arrayItem(size_t item, size_t &count)
+            {
+                parent = current;
+                index = item;
+                count = std::min(item, tree.nodes[parent].items.size());
+                return enter();
+            }
+
+            Error enter()
+            {
+                if (index >= tree.nodes[parent].items.size())
+                    return Error::NodeNotFound;
+                current = tree.nodes[parent].items[index].value;
+                return Error::NoError;
+            }
+
+            const Tree &tree;
+            size_t current;
+            size_t parent = npos;
+            size_t index = npos;
+        };
+
+        struct Target
+        {
+            size_t parent = npos;
+            size_t index = npos; // Item in parent, npos if the last segment does not exist yet
+            size_t node = npos;
+            std::string name; // Unescaped last segment
+        };
+
+        inline PatchError resolve(const Tree &tree, size_t root, const std::string &pointer, Target &target)
+        {
+            target = Target();
+            if (pointer.size() && pointer[0] != '/')
+                return PatchError::InvalidPatch;
+            TreeCursor cursor(tree, root);
+            JsonPointerMiss miss;
+            const Error error = resolveJsonPointer(cursor, pointer.data(), pointer.size(), &miss);
+            if (error == Error::NoError)
+            {
+                target.parent = cursor.parent;
+                target.index = cursor.index;
+                target.node = cursor.current;
+                return PatchError::NoError;
+            }
+            if (!miss.last)
+                return PatchError::PathNotFound;
+
+            TreeCursor parentCursor(tree, root);
+            if (resolveJsonPointer(parentCursor, pointer.data(), pointer.rfind('/'), nullptr) != Error::NoError)
+                return PatchError::PathNotFound;
+            const TreeNode &parent = tree.nodes[parentCursor.current];
+            size_t index;
+            if (parent.type == Type::ArrayStart && miss.segment != "-"
+                && !(parseJsonPointerIndex(miss.segment, index) && index == parent.items.size()))
+                return PatchError::PathNotFound;
+            target.parent = parentCursor.current;
+            target.name = std::move(miss.segment);
+            return PatchError::NoError;
+        }
+
+        // The document being patched, root is npos until it is built.
+        struct PatchedDocument
+        {
+            Tree &tree;
+            size_t root;
+            DataRef leading;
+            DataRef trailing;
+        };
+
+        inline PatchError removeValue(PatchedDocument &document, const Target &target)
+        {
+            if (target.node == npos)
+                return PatchError::PathNotFound;
+            if (target.parent == npos)
+                return PatchError::InvalidPatch;
+            Tree &tree = document.tree;
+            TreeNode &parent = tree.nodes[target.parent];
+            if (parent.items.size() == 1)
+            {
+                // The whitespace in front of the only item stays in the container.
+                if (parent.items[0].prefix.size)
+                    parent.tail = tree.store(std::string(parent.items[0].prefix.data, parent.items[0].prefix.size)
+                                             + std::string(parent.tail.data, parent.tail.size));
+            }
+            else if (target.index + 1 < parent.items.size())
+            {
+                parent.items[target.index + 1].prefix = parent.items[target.index].prefix;
+            }
+            parent.items.erase(parent.items.begin() + ptrdiff_t(target.index));
+            return PatchError::NoError;
+        }
+
+        inline PatchError replaceValue(PatchedDocument &document, const Target &target, size_t value)
+        {
+            if (target.node == npos)
+                return PatchError::PathNotFound;
+            if (target.parent == npos)
+            {
+                document.root = value;
+                document.leading = DataRef();
+                document.trailing = DataRef();
+                return PatchError::NoError;
+            }
+            document.tree.nodes[target.parent].items[target.index].value = value;
+            return PatchError::NoError;
+        }
+
+        inline PatchError addValue(PatchedDocument &document, const Target &target, size_t value)
+        {
+            Tree &tree = document.tree;
+            if (target.parent == npos || (target.node != npos && tree.nodes[target.parent].type == Type::ObjectStart))
+                return replaceValue(document, target, value);
+            TreeNode &parent = tree.nodes[target.parent];
+            TreeItem item = TreeItem();
+            item.value = value;
+            if (target.node != npos)
+            {
+                item.prefix = parent.items[target.index].prefix;
+                parent.items[target.index].prefix = DataRef(",");
+                parent.items.insert(parent.items.begin() + ptrdiff_t(target.index), item);
+                return PatchError::NoError;
+            }
+
+            if (parent.type == Type::ObjectStart)
+            {
+                std::string buffer;
+                Internal::handle_json_escapes_out(target.name, buffer);
+                item.name = tree.store(buffer.size() ? std::move(buffer) : target.name);
+                item.colon = DataRef(":");
+            }
+            if (parent.items.empty())
+            {
+                item.prefix = parent.tail;
+                parent.tail = DataRef();
+            }
+            else
+            {
+                item.prefix = DataRef(",");
+            }
+            parent.items.push_back(item);
+            return PatchError::NoError;
+        }
+
+        struct Operation
+        {
+            std::string op;
+            std::string path;
+            std::string from;
+            size_t value = npos; // Node of the value in the tree
+            bool hasFrom = false;
+        };
+
+        inline bool patchString(const TreeNode &node, std::string &string)
+        {
+            if (node.type != Type::String)
+                return false;
+            string.clear();
+            Internal::handle_json_escapes_in(stringContent(node), string);
+            return true;
+        }
+
+        inline bool parseOperations(const Tree &tree, size_t root, std::vector<Operation> &operations)
+        {
+            if (tree.nodes[root].type != Type::ArrayStart)
+                return false;
+            for (const TreeItem &item : tree.nodes[root].items)
+            {
+                const TreeNode &object = tree.nodes[item.value];
+                if (object.type != Type::ObjectStart)
+                    return false;
+                Operation operation;
+                bool hasOp = false;
+                bool hasPath = false;
+                for (const TreeItem &member : object.items)
+                {
+                    const TreeNode &node = tree.nodes[member.value];
+                    if (isJsonStringEqual(member.name, "op", 2))
+                        hasOp = patchString(node, operation.op);
+                    else if (isJsonStringEqual(member.name, "path", 4))
+                        hasPath = patchString(node, operation.path);
+                    else if (isJsonStringEqual(member.name, "from", 4))
+                        operation.hasFrom = patchString(node, operation.from);
+                    else if (isJsonStringEqual(member.name, "value", 5))
+                        operation.value = member.value;
+                }
+                if (!hasOp || !hasPath)
+                    return false;
+                operations.push_back(std::move(operation));
+            }
+            return true;
+        }
+
+        // True if from is a proper prefix of path, as in moving a value into one of its own children.
+        inline bool isPointerPrefix(const std::string &from, const std::string &path)
+        {
+            return path.size() > from.size() && path.compare(0, from.size(), from) == 0 && path[from.size()] == '/';
+        }
+    }
+}
+
+/*!
+ * Creates an RFC 6902 JSON Patch that turns the base document into the document of diff. The values in the patch
+ * are copied verbatim from the diff document.
+ */
+inline std::string createJsonPatch(const DiffTokens &diff)
+{
+    std::string patch = "[";
+    if (diff.tokens.data.size())
+    {
+        std::string path;
+        Internal::Patch::patchForValue(diff, 0, path, patch);
+    }
+    patch += ']';
+    return patch;
+}
+
+/*!
+ * Applies an RFC 6902 JSON Patch to json. The document and the patch are tokenized once into a tree that keeps the
+ * text between the values, so the formatting of the unchanged parts of the document is kept, and each operation only
+ * relinks the items of the object or array it changes. Member names are unescaped before they are compared with the
+ * segments of the pointers, and the test operation compares values as JSON. The patch is applied to the tree, so json
+ * is left untouched if any operation fails.
+ */
+inline PatchError applyJsonPatch(std::string &json, const char *patch, size_t patchSize)
+{
+    // json is only replaced at the end, so the patch may point into it.
+    Internal::Patch::Tree tree;
+    std::vector<Internal::Patch::Operation> operations;
+    const size_t patchRoot = tree.build(patch, patchSize, nullptr, nullptr);
+    if (patchRoot == Internal::Patch::npos || !Internal::Patch::parseOperations(tree, patchRoot, operations))
+        return PatchError::InvalidPatch;
+
+    Internal::Patch::PatchedDocument document = {tree, Internal::Patch::npos, DataRef(), DataRef()};
+    document.root = tree.build(json.data(), json.size(), &document.leading, &document.trailing);
+    if (document.root == Internal::Patch::npos)
+        return PatchError::InvalidJson;
+
+    for (const auto &operation : operations)
+    {
+        const std::string &op = operation.op;
+        Internal::Patch::Target target;
+        PatchError error = Internal::Patch::resolve(tree, document.root, operation.path, target);
+        if (error != PatchError::NoError)
+            return error;
+
+        if (op == "add" || op == "replace" || op == "test")
+        {
+            if (operation.value == Internal::Patch::npos)
+                return PatchError::InvalidPatch;
+            if (op == "test")
+            {
+                if (target.node == Internal::Patch::npos)
+                    error = PatchError::PathNotFound;
+                else if (!Internal::Patch::isValueEqual(tree, target.node, operation.value))
+                    error = PatchError::TestFailed;
+            }
+            else if (op == "add")
+            {
+                error = Internal::Patch::addValue(document, target, operation.value);
+            }
+            else
+            {
+                error = Internal::Patch::replaceValue(document, target, operation.value);
+            }
+        }
+        else if (op == "remove")
+        {
+            error = Internal::Patch::removeValue(document, target);
+        }
+        else if (op == "move" || op == "copy")
+        {
+            if (!operation.hasFrom)
+                return PatchError::InvalidPatch;
+            if (op == "move" && Internal::Patch::isPointerPrefix(operation.from, operation.path))
+                return PatchError::InvalidPatch;
+            Internal::Patch::Target from;
+            error = Internal::Patch::resolve(tree, document.root, operation.from, from);
+            if (error != PatchError::NoError)
+                return error;
+            if (from.node == Internal::Patch::npos)
+                return PatchError::PathNotFound;
+            size_t value = from.node;
+            if (op == "move")
+            {
+                error = Internal::Patch::removeValue(document, from);
+                if (error != PatchError::NoError)
+                    return error;
+                error = Internal::Patch::resolve(tree, document.root, operation.path, target);
+                if (error != PatchError::NoError)
+                    return error;
+            }
+            else
+            {
+                value = tree.copy(value);
+            }
+            error = Internal::Patch::addValue(document, target, value);
+        }
+        else
+        {
+            error = PatchError::InvalidPatch;
+        }
+
+        if (error != PatchError::NoError)
+            return error;
+    }
+
+    std::string result;
+    result.reserve(json.size());
+    Internal::Patch::Tree::append(result, document.leading);
+    tree.write(document.root, result);
+    Internal::Patch::Tree::append(result, document.trailing);
+    json.swap(result);
+    return PatchError::NoError;
+}
+
+inline PatchError applyJsonPatch(std::string &json, const std::string &patch)
+{
+    return applyJsonPatch(json, patch.data(), patch.size());
+}
+
 } //Namespace
 #endif //JSON_STRUCT_DIFF_H
@@ -42,6 +42,37 @@ TEST_CASE("Benchmarks", "[performance]")
       fprintf(stderr, "Failed to parse document\n");
     return smallPerson;
   };
+  BENCHMARK("StrictTokenizer_SmallObject")
+  {
+    JS::StrictTokenizer tokenizer;
+    SmallPerson smallPerson;
+    tokenizer.addData(generatedJsonObject, sizeof(generatedJsonObject)-1);
+
+    JS::Token token;
+    JS::Error error = JS::Error::NoError;
+    int object_count = 0;
+    do
+    {
+      error = tokenizer.nextToken(token);
+      if (token.value_type == JS::Type::ObjectStart)
+      {
+        object_count++;
+      }
+      else if (token.value_type == JS::Type::ObjectEnd)
+      {
+        object_count--;
+      }
+      else if (object_count == 1 && token.value_type == JS::Type::String && token.name.size == 4 &&
+               memcmp(token.name.data, "name", 4) == 0)
+      {
+        smallPerson.name = std::string(token.value.data, token.value.size);
+      }
+    } while (object_count > 0 && error == JS::Error::NoError);
+
+    if (error != JS::Error::NoError)
+      fprintf(stderr, "Failed to parse document\n");
+    return smallPerson;
+  };
   BENCHMARK("JsonStruct_SmallStruct_Object")
   {
     JS::ParseContext context(generatedJsonObject, sizeof(generatedJsonObject)-1);
@@ -386,5 +417,21 @@ TEST_CASE("Benchmarks", "[performance]")
     return people;
   };
 
+  std::string deeplyNestedJson;
+  for (int i = 0; i < 1000; i++)
+    deeplyNestedJson += i % 2 ? "{\"value\":" + std::to_string(i) + ",\"child\":" : "[" + std::to_string(i) + ",";
+  deeplyNestedJson += "null";
+  for (int i = 999; i >= 0; i--)
+    deeplyNestedJson += i % 2 ? "}" : "]";
+  JS::JsonTokens deeplyNestedTokens;
+  JS::ParseContext deeplyNestedContext(deeplyNestedJson.data(), deeplyNestedJson.size());
+  deeplyNestedContext.parseTo(deeplyNestedTokens);
+  if (deeplyNestedContext.error != JS::Error::NoError)
+    fprintf(stderr, "Failed to parse deeply nested document\n");
+
+  BENCHMARK("JsonMeta_1000_Levels_Nested")
+  {
+    return JS::metaForTokens(deeplyNestedTokens);
+  };
 }
 
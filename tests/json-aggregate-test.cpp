@@ -0,0 +1,75 @@
+#include "json_struct.h"
+
+#include "catch2/catch.hpp"
+
+namespace
+{
+const char export_json[] = R"json({
+  "items" : [
+    { "name" : "a", "price" : 10, "tags" : [1, 2] },
+    { "name" : "b", "price" : 2.5, "tags" : [] },
+    { "name" : "c", "price" : "n/a" },
+    { "name" : "d", "price" : 40, "tags" : [3] }
+  ],
+  "total" : 52.5
+})json";
+
+TEST_CASE("aggregate_single_buffer", "[json_struct][aggregate]")
+{
+  JS::JsonAggregator aggregator;
+  size_t price = aggregator.addQuery("/items/*/price", {5, 20});
+  size_t tags = aggregator.addQuery("/items/*/tags/*");
+  size_t first_tag = aggregator.addQuery("/items/0/tags/1");
+  size_t total = aggregator.addQuery("/total");
+  size_t missing = aggregator.addQuery("/nothing/*");
+  aggregator.addData(export_json, sizeof(export_json) - 1);
+  REQUIRE(aggregator.process() == JS::Error::NoError);
+
+  const JS::AggregateResult &prices = aggregator.result(price);
+  REQUIRE(prices.count == 3);
+  REQUIRE(prices.sum == 52.5);
+  REQUIRE(prices.min == 2.5);
+  REQUIRE(prices.max == 40);
+  REQUIRE(prices.mean() == 17.5);
+  REQUIRE(prices.histogram == std::vector<size_t>{1, 1, 1});
+
+  REQUIRE(aggregator.result(tags).count == 3);
+  REQUIRE(aggregator.result(tags).sum == 6);
+  REQUIRE(aggregator.result(first_tag).count == 1);
+  REQUIRE(aggregator.result(first_tag).sum == 2);
+  REQUIRE(aggregator.result(total).sum == 52.5);
+  REQUIRE(aggregator.result(missing).count == 0);
+}
+
+TEST_CASE("aggregate_in_chunks", "[json_struct][aggregate]")
+{
+  std::string json = export_json;
+  for (size_t chunk_size : {1, 3, 7, 64})
+  {
+    JS::JsonAggregator aggregator;
+    size_t price = aggregator.addQuery("/items/*/price");
+    JS::Error error = JS::Error::NoError;
+    for (size_t pos = 0; pos < json.size(); pos += chunk_size)
+    {
+      aggregator.addData(json.data() + pos, std::min(chunk_size, json.size() - pos));
+      error = aggregator.process();
+      REQUIRE((error == JS::Error::NoError || error == JS::Error::NeedMoreData));
+    }
+    REQUIRE(error == JS::Error::NoError);
+    REQUIRE(aggregator.result(price).count == 3);
+    REQUIRE(aggregator.result(price).sum == 52.5);
+  }
+}
+
+TEST_CASE("aggregate_paths", "[json_struct][aggregate]")
+{
+  const char json[] = R"json({ "a\/b" : [ { "pri\u0063e" : 1 }, { "price" : 2 } ] })json";
+  JS::JsonAggregator aggregator;
+  REQUIRE(aggregator.addQuery("items/*/price") == size_t(-1));
+  size_t price = aggregator.addQuery("/a~1b/*/price");
+  aggregator.addData(json, sizeof(json) - 1);
+  REQUIRE(aggregator.process() == JS::Error::NoError);
+  REQUIRE(aggregator.result(price).count == 2);
+  REQUIRE(aggregator.result(price).sum == 3);
+}
+} // namespace
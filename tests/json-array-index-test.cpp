@@ -0,0 +1,125 @@
+#include "json_struct.h"
+
+#include "catch2/catch.hpp"
+
+namespace
+{
+struct Record
+{
+  int id;
+  std::string name;
+  JS_OBJ(id, name);
+};
+
+std::string makeRecords(size_t count)
+{
+  std::string json = "[\n";
+  for (size_t i = 0; i < count; i++)
+  {
+    if (i)
+      json += ",\n";
+    json += "  { \"id\" : " + std::to_string(i) + ", \"name\" : \"record " + std::to_string(i) + "\", \"x\" : [[]] }";
+  }
+  json += "\n]";
+  return json;
+}
+
+TEST_CASE("array_index_parse_elements", "[json_struct][array_index]")
+{
+  std::string json = makeRecords(100);
+  for (size_t stride : {1, 7, 100, 1000})
+  {
+    JS::JsonArrayIndex index;
+    REQUIRE(index.build(json.data(), json.size(), stride) == JS::Error::NoError);
+    REQUIRE(index.size() == 100);
+    for (size_t i : {0, 1, 6, 7, 50, 99})
+    {
+      Record record;
+      REQUIRE(index.parseElement(json.data(), json.size(), i, record) == JS::Error::NoError);
+      REQUIRE(record.id == int(i));
+      REQUIRE(record.name == "record " + std::to_string(i));
+    }
+    Record record;
+    REQUIRE(index.parseElement(json.data(), json.size(), 100, record) == JS::Error::NodeNotFound);
+  }
+}
+
+TEST_CASE("array_index_scalar_elements", "[json_struct][array_index]")
+{
+  std::string json = R"json([1, "two", {"three":3}, [4], null, 6.5])json";
+  JS::JsonArrayIndex index;
+  REQUIRE(index.build(json.data(), json.size(), 2) == JS::Error::NoError);
+  REQUIRE(index.size() == 6);
+  const char *expected[] = {"1", "\"two\"", "{\"three\":3}", "[4]", "null", "6.5"};
+  for (size_t i = 0; i < 6; i++)
+  {
+    JS::DataRef element;
+    REQUIRE(index.elementRange(json.data(), json.size(), i, element) == JS::Error::NoError);
+    REQUIRE(std::string(element.data, element.size) == expected[i]);
+  }
+
+  int first = 0;
+  REQUIRE(index.parseElement(json.data(), json.size(), 0, first) == JS::Error::NoError);
+  REQUIRE(first == 1);
+  double last = 0;
+  REQUIRE(index.parseElement(json.data(), json.size(), 5, last) == JS::Error::NoError);
+  REQUIRE(last == 6.5);
+}
+
+TEST_CASE("array_index_persist", "[json_struct][array_index]")
+{
+  std::string json = makeRecords(20);
+  JS::JsonArrayIndex index;
+  REQUIRE(index.build(json.data(), json.size(), 3) == JS::Error::NoError);
+
+  std::string data = index.serialize();
+  JS::JsonArrayIndex loaded;
+  REQUIRE(loaded.deserialize(data.data(), data.size()));
+  REQUIRE(loaded.size() == 20);
+  REQUIRE(loaded.stride() == 3);
+  REQUIRE(loaded.serialize() == data);
+
+  Record record;
+  REQUIRE(loaded.parseElement(json.data(), json.size(), 17, record) == JS::Error::NoError);
+  REQUIRE(record.id == 17);
+
+  REQUIRE(!loaded.deserialize(data.data(), data.size() - 1));
+  REQUIRE(loaded.parseElement(json.data(), json.size() - 1, 17, record) == JS::Error::NodeNotFound);
+}
+
+static void setIndexValue(std::string &data, size_t position, uint64_t value)
+{
+  memcpy(&data[8 + position * sizeof(value)], &value, sizeof(value));
+}
+
+TEST_CASE("array_index_reject_corrupt", "[json_struct][array_index]")
+{
+  std::string json = makeRecords(20);
+  JS::JsonArrayIndex index;
+  REQUIRE(index.build(json.data(), json.size(), 3) == JS::Error::NoError);
+  const std::string data = index.serialize();
+  // Layout after the magic: count, stride, json size and then one offset per stride elements.
+  JS::JsonArrayIndex loaded;
+
+  std::string corrupt = data;
+  setIndexValue(corrupt, 3, json.size());
+  REQUIRE(!loaded.deserialize(corrupt.data(), corrupt.size()));
+
+  corrupt = data;
+  setIndexValue(corrupt, 5, 1);
+  REQUIRE(!loaded.deserialize(corrupt.data(), corrupt.size()));
+
+  corrupt = data;
+  setIndexValue(corrupt, 0, uint64_t(-1));
+  setIndexValue(corrupt, 1, 1);
+  REQUIRE(!loaded.deserialize(corrupt.data(), corrupt.size()));
+
+  corrupt = data;
+  setIndexValue(corrupt, 1, 0);
+  REQUIRE(!loaded.deserialize(corrupt.data(), corrupt.size()));
+
+  REQUIRE(loaded.size() == 0);
+  REQUIRE(loaded.deserialize(data.data(), data.size()));
+  REQUIRE(loaded.size() == 20);
+}
+} // namespace
@@ -0,0 +1,60 @@
+#include "json-test-data.h"
+#include "json_struct.h"
+
+#include "catch2/catch.hpp"
+
+namespace
+{
+TEST_CASE("compact_token_size", "[tokenizer][compact]")
+{
+  STATIC_REQUIRE(sizeof(JS::CompactToken) == 16);
+}
+
+TEST_CASE("compact_tokens_round_trip", "[tokenizer][compact]")
+{
+  JS::Tokenizer tokenizer;
+  tokenizer.addData(json_data2);
+
+  std::vector<JS::Token> tokens;
+  JS::CompactTokens compact;
+  JS::Token token;
+  JS::Error error = JS::Error::NoError;
+  while (error == JS::Error::NoError)
+  {
+    error = tokenizer.nextToken(token);
+    if (error == JS::Error::NoError)
+    {
+      tokens.push_back(token);
+      REQUIRE(compact.push_back(token));
+    }
+  }
+  REQUIRE(error == JS::Error::NeedMoreData);
+  REQUIRE(compact.size() == tokens.size());
+
+  size_t i = 0;
+  for (const JS::Token &t : compact)
+  {
+    REQUIRE(t.name.size == tokens[i].name.size);
+    if (t.name.size)
+      REQUIRE(t.name.data == tokens[i].name.data);
+    REQUIRE(t.value.data == tokens[i].value.data);
+    REQUIRE(t.value.size == tokens[i].value.size);
+    REQUIRE(t.name_type == tokens[i].name_type);
+    REQUIRE(t.value_type == tokens[i].value_type);
+    i++;
+  }
+  REQUIRE(i == tokens.size());
+}
+
+TEST_CASE("compact_tokens_reject_unrepresentable", "[tokenizer][compact]")
+{
+  std::string json = "{ \"" + std::string(size_t(1) << 24, 'a') + "\" : 1 }";
+
+  JS::JsonTokens tokens;
+  JS::ParseContext context(json.data(), json.size());
+  context.parseTo(tokens);
+  REQUIRE(context.error == JS::Error::TooLarge);
+  REQUIRE(tokens.data.size() == 1);
+  REQUIRE(tokens.data.front().value_type == JS::Type::ObjectStart);
+}
+} // namespace
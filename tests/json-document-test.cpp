@@ -0,0 +1,98 @@
+#include "json-test-data.h"
+#include "json_struct.h"
+
+#include "catch2/catch.hpp"
+
+namespace
+{
+const char document_json[] = R"json({
+  "name" : "doc \"one\"",
+  "count" : 42,
+  "ratio" : 0.25,
+  "flags" : [true, false, null ],
+  "nested" : { "list" : [ { "id" : 1 }, { "id" : 2 } ], "empty" : {} },
+  "last" : "end"
+})json";
+
+struct Item
+{
+  int id;
+  JS_OBJ(id);
+};
+
+TEST_CASE("document_entry_size", "[json_struct][document]")
+{
+  STATIC_REQUIRE(sizeof(JS::DocumentEntry) == 20);
+}
+
+TEST_CASE("document_navigation", "[json_struct][document]")
+{
+  JS::Document document;
+  REQUIRE(document.parse(document_json, sizeof(document_json) - 1) == JS::Error::NoError);
+  REQUIRE(document.tape().size() == 16);
+
+  JS::Document::Value root = document.root();
+  REQUIRE(root.isObject());
+  REQUIRE(root.size() == 6);
+  REQUIRE(root.text().size == sizeof(document_json) - 1);
+  REQUIRE(!root.nextSibling().isValid());
+
+  std::string name;
+  REQUIRE(root["name"].parseTo(name) == JS::Error::NoError);
+  REQUIRE(name == "doc \"one\"");
+  int count = 0;
+  REQUIRE(root["count"].parseTo(count) == JS::Error::NoError);
+  REQUIRE(count == 42);
+  double ratio = 0;
+  REQUIRE(root["ratio"].parseTo(ratio) == JS::Error::NoError);
+  REQUIRE(ratio == 0.25);
+
+  JS::Document::Value flags = root["flags"];
+  REQUIRE(flags.isArray());
+  REQUIRE(flags.size() == 3);
+  bool flag = false;
+  REQUIRE(flags[0].parseTo(flag) == JS::Error::NoError);
+  REQUIRE(flag);
+  REQUIRE(flags[2].type() == JS::Type::Null);
+  REQUIRE(!flags[3].isValid());
+  REQUIRE(flags[3].type() == JS::Type::Error);
+  REQUIRE(flags[3].name().size == 0);
+  REQUIRE(flags[3].text().size == 0);
+
+  JS::Document::Value list = root["nested"]["list"];
+  REQUIRE(list.size() == 2);
+  int id = 0;
+  REQUIRE(list[1]["id"].parseTo(id) == JS::Error::NoError);
+  REQUIRE(id == 2);
+  std::vector<Item> items;
+  REQUIRE(list.parseTo(items) == JS::Error::NoError);
+  REQUIRE(items.size() == 2);
+  REQUIRE(items[0].id == 1);
+  REQUIRE(root["nested"]["empty"].isObject());
+  REQUIRE(root["nested"]["empty"].size() == 0);
+  REQUIRE(!root["nested"]["missing"].isValid());
+  REQUIRE(root["missing"]["deeper"].parseTo(id) == JS::Error::NodeNotFound);
+
+  JS::Document::Value last = root["nested"].nextSibling();
+  REQUIRE(std::string(last.name().data, last.name().size) == "last");
+  REQUIRE(!last.nextSibling().isValid());
+}
+
+TEST_CASE("document_big", "[json_struct][document]")
+{
+  JS::Document document;
+  REQUIRE(document.parse(json_data2, sizeof(json_data2) - 1) == JS::Error::NoError);
+  JS::JsonTokens tokens;
+  JS::ParseContext context(json_data2);
+  context.parseTo(tokens);
+  size_t values = 0;
+  for (const JS::Token &token : tokens.data)
+    values += token.value_type != JS::Type::ObjectEnd && token.value_type != JS::Type::ArrayEnd;
+  REQUIRE(document.tape().size() == values);
+  REQUIRE(document.root().isValid());
+
+  const char truncated[] = R"json({"a":[1,2)json";
+  REQUIRE(document.parse(truncated, sizeof(truncated) - 1) == JS::Error::NeedMoreData);
+  REQUIRE(!document.root().isValid());
+}
+} // namespace
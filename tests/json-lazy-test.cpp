@@ -0,0 +1,67 @@
+#include "json_struct.h"
+
+#include "catch2/catch.hpp"
+
+namespace
+{
+struct Payload
+{
+  std::string kind;
+  std::vector<int> values;
+  JS_OBJ(kind, values);
+};
+
+struct Message
+{
+  int id;
+  JS::Lazy<Payload> payload;
+  JS::Lazy<std::vector<Payload>> history;
+  JS_OBJ(id, payload, history);
+};
+
+const char message_json[] = R"json({"id":7,"payload":{ "kind" : "big", "values" : [1, 2, 3] },"history":[]})json";
+
+TEST_CASE("lazy_defers_parsing", "[json_struct][lazy]")
+{
+  Message message;
+  JS::ParseContext context(message_json);
+  REQUIRE(context.parseTo(message) == JS::Error::NoError);
+  REQUIRE(message.id == 7);
+  REQUIRE(!message.payload.isParsed());
+  REQUIRE(message.payload.json == R"json({ "kind" : "big", "values" : [1, 2, 3] })json");
+
+  const Message &const_message = message;
+  REQUIRE(const_message.payload().kind == "big");
+  REQUIRE(const_message.payload().values.size() == 3);
+  REQUIRE(message.payload.isParsed());
+  REQUIRE(message.payload.error() == JS::Error::NoError);
+}
+
+TEST_CASE("lazy_serializes_untouched_bytes_verbatim", "[json_struct][lazy]")
+{
+  Message message;
+  JS::ParseContext context(message_json);
+  REQUIRE(context.parseTo(message) == JS::Error::NoError);
+
+  JS::SerializerOptions compact(JS::SerializerOptions::Compact);
+  std::string out = JS::serializeStruct(message, compact);
+  REQUIRE(out == message_json);
+
+  const Message &const_message = message;
+  REQUIRE(const_message.payload().kind == "big");
+  REQUIRE(JS::serializeStruct(message, compact) == message_json);
+
+  message.payload().values.push_back(4);
+  REQUIRE(JS::serializeStruct(message, compact) ==
+          R"json({"id":7,"payload":{"kind":"big","values":[1,2,3,4]},"history":[]})json");
+}
+
+TEST_CASE("lazy_reports_deferred_error", "[json_struct][lazy]")
+{
+  const char json[] = R"json({"id":1,"payload":{"kind":"x","values":["a"]},"history":[]})json";
+  Message message;
+  JS::ParseContext context(json);
+  REQUIRE(context.parseTo(message) == JS::Error::NoError);
+  REQUIRE(message.payload.error() != JS::Error::NoError);
+}
+} // namespace
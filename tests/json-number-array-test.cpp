@@ -0,0 +1,144 @@
+#include "json_struct.h"
+
+#include "catch2/catch.hpp"
+
+namespace
+{
+struct Series
+{
+  std::string name;
+  std::vector<double> values;
+  std::vector<int> counts;
+  std::vector<float> ratios;
+  std::vector<int64_t> stamps;
+  JS_OBJ(name, values, counts, ratios, stamps);
+};
+
+TEST_CASE("number_array_parse", "[json_struct][number_array]")
+{
+  const char json[] = R"json({
+  "name" : "series",
+  "values" : [ 1.5, -2.25e2,3 , 0.1 ],
+  "counts" : [],
+  "ratios" : [ 0.5,
+               0.25 ],
+  "stamps" : [ 1600000000000, -1 ]
+})json";
+  Series series;
+  series.counts.push_back(9);
+  JS::ParseContext context(json);
+  REQUIRE(context.parseTo(series) == JS::Error::NoError);
+  REQUIRE(series.name == "series");
+  REQUIRE(series.values == std::vector<double>({1.5, -225.0, 3.0, 0.1}));
+  REQUIRE(series.counts.empty());
+  REQUIRE(series.ratios == std::vector<float>({0.5f, 0.25f}));
+  REQUIRE(series.stamps == std::vector<int64_t>({1600000000000, -1}));
+}
+
+TEST_CASE("number_array_large", "[json_struct][number_array]")
+{
+  std::string json = "[";
+  for (int i = 0; i < 100000; i++)
+  {
+    if (i)
+      json += ",";
+    json += std::to_string(i);
+  }
+  json += "]";
+
+  std::vector<int> ints;
+  JS::ParseContext context(json);
+  REQUIRE(context.parseTo(ints) == JS::Error::NoError);
+  REQUIRE(ints.size() == 100000);
+  REQUIRE(ints.capacity() == 100000);
+  REQUIRE(ints[99999] == 99999);
+}
+
+TEST_CASE("number_array_falls_back", "[json_struct][number_array]")
+{
+  // Split over two buffers
+  JS::ParseContext split;
+  std::vector<double> values;
+  split.tokenizer.addData("[ 1.5, 2");
+  split.tokenizer.addData(".5, 3 ]");
+  REQUIRE(split.parseTo(values) == JS::Error::NoError);
+  REQUIRE(values == std::vector<double>({1.5, 2.5, 3.0}));
+
+  // Superfluous comma is left to the tokenizer
+  JS::ParseContext lenient("[ 1, 2, ]");
+  lenient.tokenizer.allowSuperfluousComma(true);
+  std::vector<int> ints;
+  REQUIRE(lenient.parseTo(ints) == JS::Error::NoError);
+  REQUIRE(ints == std::vector<int>({1, 2}));
+
+  JS::ParseContext missing_comma("[ 1 2 ]");
+  REQUIRE(missing_comma.parseTo(ints) != JS::Error::NoError);
+
+  JS::ParseContext not_a_number("[ 1, 2.5e, 3 ]");
+  REQUIRE(not_a_number.parseTo(values) == JS::Error::FailedToParseDouble);
+
+  JS::ParseContext mixed("[ 1, \"2\", 3 ]");
+  REQUIRE(mixed.parseTo(ints) == JS::Error::NoError);
+  REQUIRE(ints == std::vector<int>({1, 2, 3}));
+}
+
+template <typename T>
+std::string serializePerToken(const std::vector<T> &vec, const JS::SerializerOptions &options)
+{
+  std::string out;
+  JS::Token token;
+  JS::Serializer serializer;
+  serializer.setOptions(options);
+  auto cbref = serializer.addRequestBufferCallback([&out](JS::Serializer &serializer_p) {
+    size_t end = out.size();
+    out.resize(end * 2);
+    serializer_p.appendBuffer(&out[0] + end, end);
+  });
+  out.resize(64);
+  serializer.appendBuffer(&out[0], out.size());
+  token.value_type = JS::Type::ArrayStart;
+  token.value = JS::DataRef("[");
+  serializer.write(token);
+  for (const T &value : vec)
+    JS::TypeHandler<T>::from(value, token, serializer);
+  token.value_type = JS::Type::ArrayEnd;
+  token.value = JS::DataRef("]");
+  serializer.write(token);
+  size_t used = 0;
+  for (auto &buffer : serializer.buffers())
+    used += buffer.used;
+  out.resize(used);
+  return out;
+}
+
+TEST_CASE("number_array_serialize", "[json_struct][number_array]")
+{
+  Series series;
+  series.name = "series";
+  for (int i = 0; i < 1000; i++)
+  {
+    series.values.push_back(i * 0.37 - 100);
+    series.counts.push_back(i * 7919 - 3000000);
+  }
+  series.ratios = {0.5f, 0.1f};
+
+  for (JS::SerializerOptions::Style style : {JS::SerializerOptions::Pretty, JS::SerializerOptions::Compact})
+  {
+    JS::SerializerOptions options(style);
+    std::string out = JS::serializeStruct(series, options);
+    Series parsed;
+    JS::ParseContext context(out);
+    REQUIRE(context.parseTo(parsed) == JS::Error::NoError);
+    REQUIRE(parsed.values == series.values);
+    REQUIRE(parsed.counts == series.counts);
+    REQUIRE(parsed.ratios == series.ratios);
+    REQUIRE(parsed.stamps.empty());
+
+    REQUIRE(JS::serializeStruct(series.values, options) == serializePerToken(series.values, options));
+    REQUIRE(JS::serializeStruct(series.counts, options) == serializePerToken(series.counts, options));
+    REQUIRE(JS::serializeStruct(series.ratios, options) == serializePerToken(series.ratios, options));
+  }
+  REQUIRE(JS::serializeStruct(std::vector<int>({1, 2, 3}), JS::SerializerOptions(JS::SerializerOptions::Compact)) ==
+          "[1,2,3]");
+}
+} // namespace
@@ -0,0 +1,144 @@
+#include "json_struct.h"
+
+#include "catch2/catch.hpp"
+
+namespace
+{
+const char config_json[] = R"json({
+  "name" : "service",
+  "limits" : { "cpu" : 2, "memory" : "1G" },
+  "servers" : [
+    { "host" : "a", "tags" : ["x", "y"] },
+    { "host" : "b", "tags" : [] }
+  ],
+  "a/b" : true,
+  "m~n" : null
+})json";
+
+std::string findValue(const std::string &json, const std::string &pointer)
+{
+  JS::DataRef value;
+  JS::Error error = JS::findJsonPointer(json.data(), json.size(), pointer.data(), pointer.size(), value);
+  REQUIRE(error == JS::Error::NoError);
+  return std::string(value.data, value.size);
+}
+
+TEST_CASE("json_pointer_find", "[json_struct][json_pointer]")
+{
+  std::string json = config_json;
+  REQUIRE(findValue(json, "") == json);
+  REQUIRE(findValue(json, "/name") == "\"service\"");
+  REQUIRE(findValue(json, "/limits") == R"json({ "cpu" : 2, "memory" : "1G" })json");
+  REQUIRE(findValue(json, "/limits/cpu") == "2");
+  REQUIRE(findValue(json, "/servers/1/host") == "\"b\"");
+  REQUIRE(findValue(json, "/servers/0/tags/1") == "\"y\"");
+  REQUIRE(findValue(json, "/servers/1/tags") == "[]");
+  REQUIRE(findValue(json, "/a~1b") == "true");
+  REQUIRE(findValue(json, "/m~0n") == "null");
+
+  JS::DataRef value;
+  std::string missing[] = {"/nope", "/servers/2", "/servers/01", "/servers/-", "/name/x", "name"};
+  for (const std::string &pointer : missing)
+    REQUIRE(JS::findJsonPointer(json.data(), json.size(), pointer.data(), pointer.size(), value) ==
+            JS::Error::NodeNotFound);
+}
+
+TEST_CASE("json_pointer_replace", "[json_struct][json_pointer]")
+{
+  std::string json = config_json;
+  REQUIRE(JS::replaceJsonPointer(json, "/limits/cpu", "16") == JS::Error::NoError);
+  REQUIRE(JS::replaceJsonPointer(json, "/servers/0", R"json({"host":"c"})json") == JS::Error::NoError);
+  REQUIRE(JS::replaceJsonPointer(json, "/name", "\"renamed\"") == JS::Error::NoError);
+  REQUIRE(JS::replaceJsonPointer(json, "/missing", "1") == JS::Error::NodeNotFound);
+
+  const char expected[] = R"json({
+  "name" : "renamed",
+  "limits" : { "cpu" : 16, "memory" : "1G" },
+  "servers" : [
+    {"host":"c"},
+    { "host" : "b", "tags" : [] }
+  ],
+  "a/b" : true,
+  "m~n" : null
+})json";
+  REQUIRE(json == expected);
+}
+
+struct Limits
+{
+  int cpu;
+  std::string memory;
+  JS_OBJ(cpu, memory);
+};
+
+TEST_CASE("json_pointer_extract", "[json_struct][json_pointer]")
+{
+  std::string json = config_json;
+  std::string host;
+  Limits limits;
+  std::vector<std::string> tags;
+  bool slash = false;
+  JS::Error error = JS::extract(json, {"/servers/1/host", "/limits", "/servers/0/tags", "/a~1b"}, host, limits, tags, slash);
+  REQUIRE(error == JS::Error::NoError);
+  REQUIRE(host == "b");
+  REQUIRE(limits.cpu == 2);
+  REQUIRE(limits.memory == "1G");
+  REQUIRE(tags == std::vector<std::string>{"x", "y"});
+  REQUIRE(slash);
+
+  std::string name;
+  int missing = 0;
+  REQUIRE(JS::extract(json, {"/name", "/servers/5/host"}, name, missing) == JS::Error::NodeNotFound);
+  REQUIRE(name == "service");
+
+  Limits whole;
+  REQUIRE(JS::extract(R"json({"cpu":4,"memory":"2G"})json", {""}, whole) == JS::Error::NoError);
+  REQUIRE(whole.cpu == 4);
+
+  int cpu = 0;
+  REQUIRE(JS::extract(json, {"/limits/cpu"}, cpu) == JS::Error::NoError);
+  REQUIRE(cpu == 2);
+  REQUIRE(JS::extract(json, {"/limits"}, cpu) != JS::Error::NoError);
+}
+
+TEST_CASE("json_pointer_extract_overlapping_paths", "[json_struct][json_pointer]")
+{
+  std::string json = config_json;
+  Limits limits;
+  int cpu = 0;
+  std::string memory;
+  double cpuAsDouble = 0.0;
+  REQUIRE(JS::extract(json, {"/limits", "/limits/cpu", "/limits/memory", "/limits/cpu"}, limits, cpu, memory,
+                      cpuAsDouble) == JS::Error::NoError);
+  REQUIRE(limits.cpu == 2);
+  REQUIRE(limits.memory == "1G");
+  REQUIRE(cpu == 2);
+  REQUIRE(memory == "1G");
+  REQUIRE(cpuAsDouble == 2.0);
+
+  std::string host;
+  std::string hostAgain;
+  std::vector<std::string> tags;
+  std::string tag;
+  REQUIRE(JS::extract(json, {"/servers/1/host", "/servers/0/tags/1", "/servers/1/host", "/servers/0/tags"}, host, tag,
+                      hostAgain, tags) == JS::Error::NoError);
+  REQUIRE(host == "b");
+  REQUIRE(hostAgain == "b");
+  REQUIRE(tag == "y");
+  REQUIRE(tags == std::vector<std::string>{"x", "y"});
+}
+
+TEST_CASE("json_pointer_escaped_names", "[json_struct][json_pointer]")
+{
+  std::string json = R"json({"a\/b": {"q\"uote": 1, "\u00e9": 2}})json";
+  JS::DataRef value;
+  REQUIRE(JS::findJsonPointer(json.data(), json.size(), "/a~1b/q\"uote", 12, value) == JS::Error::NoError);
+  REQUIRE(std::string(value.data, value.size) == "1");
+
+  int quote = 0;
+  int accent = 0;
+  REQUIRE(JS::extract(json, {"/a~1b/q\"uote", "/a~1b/\xc3\xa9"}, quote, accent) == JS::Error::NoError);
+  REQUIRE(quote == 1);
+  REQUIRE(accent == 2);
+}
+} // namespace
@@ -0,0 +1,80 @@
+#include "json_struct.h"
+#include <limits>
+
+#include "catch2/catch.hpp"
+
+namespace
+{
+struct Forwarded
+{
+  std::string id;
+  JS::RawNumber amount;
+  std::vector<JS::RawNumber> readings;
+  JS::RawNumberRef scale;
+  JS_OBJ(id, amount, readings, scale);
+};
+
+TEST_CASE("raw_number_round_trip", "[json_struct][raw_number]")
+{
+  const char json[] =
+    R"json({"id":"a","amount":12345678901234567890123,"readings":[1.50,-0.0,1e-7,2E+3],"scale":0.100})json";
+  Forwarded forwarded;
+  JS::ParseContext context(json);
+  REQUIRE(context.parseTo(forwarded) == JS::Error::NoError);
+  REQUIRE(forwarded.amount.data == "12345678901234567890123");
+  REQUIRE(forwarded.readings.size() == 4);
+  REQUIRE(forwarded.readings[0].data == "1.50");
+
+  std::string out = JS::serializeStruct(forwarded, JS::SerializerOptions(JS::SerializerOptions::Compact));
+  REQUIRE(out == json);
+
+  double reading = 0;
+  REQUIRE(forwarded.readings[3].parseTo(reading) == JS::Error::NoError);
+  REQUIRE(reading == 2000.0);
+  float scale = 0;
+  REQUIRE(forwarded.scale.parseTo(scale) == JS::Error::NoError);
+  REQUIRE(scale == 0.1f);
+  int integer = 0;
+  REQUIRE(forwarded.readings[0].parseTo(integer) == JS::Error::FailedToParseInt);
+}
+
+TEST_CASE("raw_number_parse_integers", "[json_struct][raw_number]")
+{
+  int integer = 7;
+  REQUIRE(JS::RawNumber{"1.50"}.parseTo(integer) == JS::Error::FailedToParseInt);
+  REQUIRE(JS::RawNumber{"2E+3"}.parseTo(integer) == JS::Error::FailedToParseInt);
+  REQUIRE(JS::RawNumber{"12abc"}.parseTo(integer) == JS::Error::FailedToParseInt);
+  REQUIRE(JS::RawNumber{"-"}.parseTo(integer) == JS::Error::FailedToParseInt);
+  REQUIRE(JS::RawNumber{"2147483648"}.parseTo(integer) == JS::Error::FailedToParseInt);
+  REQUIRE(JS::RawNumber{"-2147483648"}.parseTo(integer) == JS::Error::NoError);
+  REQUIRE(integer == std::numeric_limits<int>::min());
+  REQUIRE(JS::RawNumber{"-0"}.parseTo(integer) == JS::Error::NoError);
+  REQUIRE(integer == 0);
+
+  uint64_t big = 0;
+  REQUIRE(JS::RawNumber{"18446744073709551615"}.parseTo(big) == JS::Error::NoError);
+  REQUIRE(big == std::numeric_limits<uint64_t>::max());
+  REQUIRE(JS::RawNumber{"18446744073709551616"}.parseTo(big) == JS::Error::FailedToParseInt);
+  REQUIRE(JS::RawNumber{"-1"}.parseTo(big) == JS::Error::FailedToParseInt);
+  int64_t small = 0;
+  REQUIRE(JS::RawNumber{"-9223372036854775808"}.parseTo(small) == JS::Error::NoError);
+  REQUIRE(small == std::numeric_limits<int64_t>::min());
+  REQUIRE(JS::RawNumber{"9223372036854775808"}.parseTo(small) == JS::Error::FailedToParseInt);
+
+  double number = 0;
+  REQUIRE(JS::RawNumber{"1.5x"}.parseTo(number) == JS::Error::FailedToParseDouble);
+  REQUIRE(JS::RawNumber{"-1.5e2"}.parseTo(number) == JS::Error::NoError);
+  REQUIRE(number == -150.0);
+}
+
+TEST_CASE("raw_number_rejects_other_types", "[json_struct][raw_number]")
+{
+  const char json[] = R"json({"id":"a","amount":"12"})json";
+  Forwarded forwarded;
+  JS::ParseContext context(json);
+  REQUIRE(context.parseTo(forwarded) == JS::Error::IllegalDataValue);
+
+  JS::RawNumber empty;
+  REQUIRE(JS::serializeStruct(empty) == "0");
+}
+} // namespace
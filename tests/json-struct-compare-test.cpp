@@ -0,0 +1,287 @@
+#include "json_struct.h"
+
+#include "catch2/catch.hpp"
+
+#include <map>
+#include <set>
+#include <unordered_map>
+
+namespace
+{
+struct Address
+{
+  std::string street;
+  std::string city;
+  JS_OBJ(street, city);
+};
+
+struct Friend
+{
+  std::string name;
+  int age = 0;
+  JS_OBJ(name, age);
+};
+
+struct PersonBase
+{
+  int id = 0;
+  JS_OBJ(id);
+};
+
+struct Person : public PersonBase
+{
+  std::string name;
+  Address address;
+  std::vector<Friend> friends;
+  std::vector<int> scores;
+  std::unique_ptr<Address> work;
+  JS::OptionalChecked<double> height;
+  JS_OBJ_SUPER(JS_SUPER(PersonBase), name, address, friends, scores, work, height);
+};
+
+void fillPerson(Person &person)
+{
+  person.id = 4;
+  person.name = "Ada";
+  person.address.street = "Main street";
+  person.address.city = "Oslo";
+  person.friends.resize(2);
+  person.friends[0].name = "Bob";
+  person.friends[0].age = 33;
+  person.friends[1].name = "Eve";
+  person.friends[1].age = 29;
+  person.scores = {1, 2, 3};
+  person.work.reset(new Address());
+  person.work->city = "Bergen";
+}
+
+TEST_CASE("diff_structs_equal", "[json_struct][diff_structs]")
+{
+  Person a;
+  Person b;
+  fillPerson(a);
+  fillPerson(b);
+  REQUIRE(JS::diffStructs(a, b).empty());
+}
+
+TEST_CASE("diff_structs_changed_members", "[json_struct][diff_structs]")
+{
+  Person a;
+  Person b;
+  fillPerson(a);
+  fillPerson(b);
+
+  b.id = 5;
+  b.address.city = "Trondheim";
+  b.friends[1].age = 30;
+  b.scores.push_back(4);
+  b.work->street = "Harbour";
+  b.height = 1.70;
+
+  std::vector<std::string> changed = JS::diffStructs(a, b);
+  std::vector<std::string> expected = {"/address/city", "/friends/1/age", "/scores", "/work/street", "/height", "/id"};
+  REQUIRE(changed == expected);
+}
+
+TEST_CASE("diff_structs_null_pointer", "[json_struct][diff_structs]")
+{
+  Person a;
+  Person b;
+  fillPerson(a);
+  fillPerson(b);
+  b.work.reset();
+
+  std::vector<std::string> changed = JS::diffStructs(a, b);
+  REQUIRE(changed.size() == 1);
+  REQUIRE(changed[0] == "/work");
+}
+
+TEST_CASE("serialize_delta_only_changed_members", "[json_struct][serialize_delta]")
+{
+  Person previous;
+  Person current;
+  fillPerson(previous);
+  fillPerson(current);
+  REQUIRE(JS::serializeStructDelta(current, previous, JS::SerializerOptions(JS::SerializerOptions::Compact)) == "{}");
+
+  current.id = 5;
+  current.address.city = "Trondheim";
+  current.friends[1].age = 30;
+  current.work.reset();
+  current.height = 1.5;
+
+  std::string delta = JS::serializeStructDelta(current, previous, JS::SerializerOptions(JS::SerializerOptions::Compact));
+  REQUIRE(delta == R"json({"address":{"city":"Trondheim"},"friends":[{"name":"Bob","age":33},{"name":"Eve","age":30}],)json"
+                   R"json("work":null,"height":1.5,"id":5})json");
+}
+
+struct Household
+{
+  Person owner;
+  std::unique_ptr<Person> guest;
+  int rooms = 0;
+  JS_OBJ(owner, guest, rooms);
+};
+
+TEST_CASE("serialize_delta_skips_unchanged_nested_structs", "[json_struct][serialize_delta]")
+{
+  Household previous;
+  Household current;
+  fillPerson(previous.owner);
+  fillPerson(current.owner);
+  previous.guest.reset(new Person());
+  current.guest.reset(new Person());
+  fillPerson(*previous.guest);
+  fillPerson(*current.guest);
+  JS::SerializerOptions compact(JS::SerializerOptions::Compact);
+  REQUIRE(JS::serializeStructDelta(current, previous, compact) == "{}");
+
+  current.rooms = 3;
+  REQUIRE(JS::serializeStructDelta(current, previous, compact) == R"json({"rooms":3})json");
+
+  current.guest->work->city = "Molde";
+  REQUIRE(JS::serializeStructDelta(current, previous, compact) ==
+          R"json({"guest":{"work":{"city":"Molde"}},"rooms":3})json");
+
+  current.owner.address.street = "Quay";
+  current.guest->work->city = "Bergen";
+  current.guest->name = "Lin";
+  REQUIRE(JS::serializeStructDelta(current, previous, compact) ==
+          R"json({"owner":{"address":{"street":"Quay"}},"guest":{"name":"Lin"},"rooms":3})json");
+}
+
+TEST_CASE("serialize_delta_applies_with_parse", "[json_struct][serialize_delta]")
+{
+  Person previous;
+  Person current;
+  fillPerson(previous);
+  fillPerson(current);
+  current.name = "Grace";
+  current.address.street = "Side street";
+  current.scores.pop_back();
+  current.work->city = "Stavanger";
+
+  std::string delta = JS::serializeStructDelta(current, previous);
+  JS::ParseContext context(delta);
+  REQUIRE(context.parseTo(previous) == JS::Error::NoError);
+  REQUIRE(JS::diffStructs(current, previous).empty());
+
+  current.work.reset();
+  delta = JS::serializeStructDelta(current, previous);
+  JS::ParseContext context2(delta);
+  REQUIRE(context2.parseTo(previous) == JS::Error::NoError);
+  REQUIRE(!previous.work);
+  REQUIRE(JS::diffStructs(current, previous).empty());
+}
+
+TEST_CASE("hash_and_equal_structs", "[json_struct][hash_struct]")
+{
+  Person a;
+  Person b;
+  fillPerson(a);
+  fillPerson(b);
+  REQUIRE(JS::equalStructs(a, b));
+  REQUIRE(JS::hashStruct(a) == JS::hashStruct(b));
+
+  b.friends[0].name = "Rob";
+  REQUIRE(!JS::equalStructs(a, b));
+  REQUIRE(JS::hashStruct(a) != JS::hashStruct(b));
+
+  b.friends[0].name = "Bob";
+  b.id = 7;
+  REQUIRE(!JS::equalStructs(a, b));
+  REQUIRE(JS::hashStruct(a) != JS::hashStruct(b));
+
+  b.id = a.id;
+  b.height = -0.0;
+  a.height = 0.0;
+  REQUIRE(JS::equalStructs(a, b));
+  REQUIRE(JS::hashStruct(a) == JS::hashStruct(b));
+
+  b.work.reset();
+  REQUIRE(!JS::equalStructs(a, b));
+  REQUIRE(JS::hashStruct(a) != JS::hashStruct(b));
+}
+
+struct Registry
+{
+  std::map<std::string, Friend> byName;
+  std::unordered_map<int, std::vector<Friend>> byAge;
+  std::set<int> ids;
+  JS_OBJ(byName, byAge, ids);
+};
+
+static_assert(!JS::Internal::HasEqualOperator<std::vector<Friend>>::value, "Friend has no operator==");
+static_assert(!JS::Internal::HasEqualOperator<std::map<std::string, Friend>>::value, "Friend has no operator==");
+static_assert(JS::Internal::HasEqualOperator<std::map<std::string, int>>::value, "int has operator==");
+
+TEST_CASE("diff_structs_containers_of_structs", "[json_struct][diff_structs]")
+{
+  Registry a;
+  a.byName["Bob"].age = 33;
+  a.byAge[33].resize(1);
+  a.byAge[33][0].name = "Bob";
+  a.ids = {1, 2};
+  Registry b;
+  b.ids = {2, 1};
+  b.byAge[33].resize(1);
+  b.byAge[33][0].name = "Bob";
+  b.byName["Bob"].age = 33;
+  REQUIRE(JS::equalStructs(a, b));
+  REQUIRE(JS::diffStructs(a, b).empty());
+
+  b.byName["Bob"].age = 34;
+  b.byAge[33][0].name = "Rob";
+  std::vector<std::string> expected = {"/byName", "/byAge"};
+  REQUIRE(JS::diffStructs(a, b) == expected);
+
+  b.byName = a.byName;
+  b.byAge = a.byAge;
+  b.ids.insert(3);
+  REQUIRE(!JS::equalStructs(a, b));
+}
+
+struct Inventory
+{
+  std::unordered_map<std::string, int> counts;
+  std::unordered_map<int, Friend> owners;
+  std::map<std::string, std::vector<int>> sorted;
+  JS_OBJ(counts, owners, sorted);
+};
+
+TEST_CASE("hash_structs_unordered_containers", "[json_struct][hash_struct]")
+{
+  Inventory a;
+  Inventory b;
+  for (int i = 0; i < 100; i++)
+  {
+    a.counts["item" + std::to_string(i)] = i;
+    a.owners[i].age = i;
+  }
+  // A different insertion history and bucket count gives a different iteration order.
+  b.counts.reserve(1000);
+  for (int i = 99; i >= 0; i--)
+  {
+    b.counts["item" + std::to_string(i)] = i;
+    b.owners[i].age = i;
+  }
+  b.counts["extra"] = 1;
+  b.counts.erase("extra");
+  a.sorted["x"] = {1, 2};
+  a.sorted["y"] = {3};
+  b.sorted["y"] = {3};
+  b.sorted["x"] = {1, 2};
+
+  REQUIRE(JS::equalStructs(a, b));
+  REQUIRE(JS::hashStruct(a) == JS::hashStruct(b));
+
+  b.owners[5].age = 6;
+  REQUIRE(!JS::equalStructs(a, b));
+  REQUIRE(JS::hashStruct(a) != JS::hashStruct(b));
+  b.owners[5].age = 5;
+
+  b.sorted["x"] = {2, 1};
+  REQUIRE(!JS::equalStructs(a, b));
+  REQUIRE(JS::hashStruct(a) != JS::hashStruct(b));
+}
+} // namespace
@@ -1,5 +1,5 @@
 /*
- * Copyright  2018 ystein Myrmo
+ * Copyright © 2018 Øystein Myrmo
  *
  * Permission to use, copy, modify, distribute, and sell this software and its
  * documentation for any purpose is hereby granted without fee, provided that
@@ -22,7 +22,9 @@
 
 #include "catch2/catch.hpp"
 #include "json_struct_diff.h"
+#include <atomic>
 #include <memory>
+#include <stdexcept>
 
 namespace
 {
@@ -217,6 +219,19 @@ const char basicDiffOptionsJsonAlmostEqual[] = R"json(
 }
 )json";
 
+
+TEST_CASE("diff_check_too_large_token", "[json_struct][diff]")
+{
+  std::string json = "{ \"a\" : [ { \"" + std::string(size_t(1) << 24, 'a') + "\" : 1 } ] }";
+
+  JS::DiffTokens tokens(json.data(), json.size());
+  REQUIRE(tokens.error == JS::DiffError::TooLarge);
+  REQUIRE(tokens.meta.empty());
+
+  JS::DiffContext diffContext(R"json({ "a" : [] })json");
+  REQUIRE(diffContext.diff(json) == size_t(-1));
+  REQUIRE(diffContext.error == JS::DiffError::TooLarge);
+}
 TEST_CASE("diff_check_diff_options", "[json_struct][diff]")
 {
   std::string jsonBase(basicDiffOptionsJson);
@@ -570,7 +585,7 @@ const char largeObjectWithAllDataTypes[] = R"json(
     "member22": -3.456e5,
     "member23": -3.456E5,
     "member24": "iamastring",
-    "member25": "1234567890abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ \" \\\/\b\f\n\r\t!@#$%^&*()_+-=[]{};:',.<>",
+    "member25": "1234567890abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ \" \\\/\b\f\n\r\t!@#$%^&*()_+-=[]{};:',.<>æøåÆØÅàáâäèéêëòóôô",
     "member26": "",
     "member27": {},
     "member28": [],
@@ -608,7 +623,7 @@ const char largeObjectWithAllDataTypesEqual[] = R"json(
     "member22": -3.456e5,
     "member23": -3.456E5,
     "member24": "iamastring",
-    "member25": "1234567890abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ \" \\\/\b\f\n\r\t!@#$%^&*()_+-=[]{};:',.<>",
+    "member25": "1234567890abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ \" \\\/\b\f\n\r\t!@#$%^&*()_+-=[]{};:',.<>æøåÆØÅàáâäèéêëòóôô",
     "member26": "",
     "member27": {},
     "member28": [],
@@ -646,7 +661,7 @@ const char largeObjectWithAllDataTypesDifferent[] = R"json(
     "member22": -3.456e5,
     "member23": -3.456E5,
     "member24": "iamastring",
-    "member25": "1234567890abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ \" \\\/\b\f\n\r\t!@#$%^&*()_+-=[]{};:',.<>",
+    "member25": "1234567890abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ \" \\\/\b\f\n\r\t!@#$%^&*()_+-=[]{};:',.<>æøåÆØÅàáâäèéêëòóôô",
     "member26": "",
     "member27": {},
     "member28": [],
@@ -1116,4 +1131,508 @@ TEST_CASE("diff_check_new_and_missing_members_nested", "[json_struct][diff]")
   REQUIRE(strncmp(token.value.data, "d", token.value.size) == 0);
 }
 
+TEST_CASE("diff_check_large_object_hashed_members", "[json_struct][diff]")
+{
+  std::string baseJson = "{";
+  std::string diffJson = "{\"k1\":1000,\"k2\":\"two\"";
+  for (int i = 0; i < 100; i++)
+  {
+    baseJson += (i ? ",\"k" : "\"k") + std::to_string(i) + "\":" + std::to_string(i);
+    if (i > 2)
+      diffJson += ",\"k" + std::to_string(i) + "\":" + std::to_string(i);
+  }
+  baseJson += "}";
+  diffJson += ",\"new\":{\"a\":1}}";
+
+  JS::DiffContext diffContext(baseJson);
+  REQUIRE(diffContext.error == JS::DiffError::NoError);
+  size_t diffPos = diffContext.diff(diffJson);
+  REQUIRE(diffContext.error == JS::DiffError::NoError);
+  const JS::DiffTokens &diff = diffContext.diffs[diffPos];
+
+  REQUIRE(diff.size() == 104);
+  REQUIRE(diff.diff_count == 6);
+  REQUIRE(diff.diffs[0] == JS::DiffType::MissingMembers);
+  REQUIRE(diff.diffs[1] == JS::DiffType::ValueDiff);
+  REQUIRE(diff.diffs[2] == JS::DiffType::TypeDiff);
+  for (size_t i = 3; i < 100; i++)
+    REQUIRE(diff.diffs[i] == JS::DiffType::NoDiff);
+  REQUIRE(diff.diffs[100] == JS::DiffType::NewMember);
+  REQUIRE(diff.diffs[101] == JS::DiffType::NewMember);
+  REQUIRE(diff.diffs[102] == JS::DiffType::NewMember);
+  REQUIRE(diff.diffs[103] == JS::DiffType::NoDiff);
+
+  const JS::Token &root = diff.tokens.data[0];
+  const std::vector<JS::Token> *missing = diff.getMissingMembers(root);
+  REQUIRE(missing);
+  REQUIRE(missing->size() == 1);
+  REQUIRE(std::string((*missing)[0].name.data, (*missing)[0].name.size) == "k0");
+}
+
+TEST_CASE("diff_check_equal_subtrees_are_skipped", "[json_struct][diff]")
+{
+  std::string baseJson = R"json({"a": {"x": [1, 2, {"y": "z"}]}, "b": [1, 2], "c": {"x": [1, 2, {"y": "z"}]}})json";
+  std::string diffJson = R"json({
+    "a" : { "x" : [ 1, 2, { "y" : "z" } ] },
+    "b" : [ 1, 3 ],
+    "c" : { "x" : [ 1, 2, { "y" : "w" } ] }
+})json";
+
+  JS::DiffTokens base(baseJson.data(), baseJson.size());
+  JS::DiffTokens diff(diffJson.data(), diffJson.size());
+  REQUIRE(base.subtreeHashes.size() == base.meta.size());
+  REQUIRE(base.isSubtreeEqual(0, base, 0));
+  REQUIRE(base.isSubtreeEqual(1, diff, 1));
+  REQUIRE(base.isSubtreeEqual(1, base, 14));
+  REQUIRE(!base.isSubtreeEqual(10, diff, 10));
+  REQUIRE(!base.isSubtreeEqual(14, diff, 14));
+  REQUIRE(!base.isSubtreeEqual(0, diff, 0));
+
+  JS::Internal::Diff::diff(base, diff);
+  REQUIRE(diff.diff_count == 2);
+  REQUIRE(diff.diffs[12] == JS::DiffType::ValueDiff);
+  REQUIRE(diff.diffs[19] == JS::DiffType::ValueDiff);
+
+  // A forced hash collision is caught by comparing the tokens
+  diff.invalidate();
+  diff.subtreeHashes[diff.metaIndex[14]] = base.subtreeHashes[base.metaIndex[14]];
+  REQUIRE(!base.isSubtreeEqual(14, diff, 14));
+  JS::Internal::Diff::diff(base, diff);
+  REQUIRE(diff.diffs[19] == JS::DiffType::ValueDiff);
+}
+
+TEST_CASE("diff_check_aligned_array_diff", "[json_struct][diff]")
+{
+  std::string baseJson = R"json([1, 2, 3, {"a": [4, 5]}, "six", 7])json";
+  std::string diffJson = R"json([0, 1, 2, 3, {"a": [4, 5]}, 7, 8])json";
+  JS::DiffOptions options(JS::DiffFlags::FuzzyFloatComparison | JS::DiffFlags::AlignArrays, 1e-6);
+
+  JS::DiffContext diffContext(baseJson, options);
+  REQUIRE(diffContext.error == JS::DiffError::NoError);
+  size_t diffPos = diffContext.diff(diffJson);
+  REQUIRE(diffContext.error == JS::DiffError::NoError);
+  const JS::DiffTokens &diff = diffContext.diffs[diffPos];
+
+  REQUIRE(diff.size() == 14);
+  REQUIRE(diff.diff_count == 3);
+  REQUIRE(diff.diffs[0] == JS::DiffType::MissingArrayItems);
+  REQUIRE(diff.diffs[1] == JS::DiffType::NewArrayItem);
+  for (size_t i = 2; i < 12; i++)
+    REQUIRE(diff.diffs[i] == JS::DiffType::NoDiff);
+  REQUIRE(diff.diffs[12] == JS::DiffType::NewArrayItem);
+  REQUIRE(diff.diffs[13] == JS::DiffType::NoDiff);
+
+  const std::vector<JS::Token> *missing = diff.getMissingArrayItems(diff.tokens.data[0]);
+  REQUIRE(missing);
+  REQUIRE(missing->size() == 1);
+  REQUIRE(std::string((*missing)[0].value.data, (*missing)[0].value.size) == "six");
+
+  JS::DiffContext positionalContext(baseJson);
+  diffPos = positionalContext.diff(diffJson);
+  REQUIRE(positionalContext.diffs[diffPos].diff_count > diff.diff_count);
+}
+
+TEST_CASE("diff_check_aligned_array_minimal_edits", "[json_struct][diff]")
+{
+  JS::DiffOptions options(JS::DiffFlags::AlignArrays, 0);
+  unsigned int seed = 7;
+  for (int round = 0; round < 50; round++)
+  {
+    std::vector<int> a;
+    std::vector<int> b;
+    for (int i = 0; i < 5 + round % 20; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      a.push_back(int((seed >> 16) % 4));
+      seed = seed * 1103515245 + 12345;
+      b.push_back(int((seed >> 16) % 4));
+    }
+    std::vector<std::vector<size_t>> lcs(a.size() + 1, std::vector<size_t>(b.size() + 1, 0));
+    for (size_t i = 1; i <= a.size(); i++)
+      for (size_t j = 1; j <= b.size(); j++)
+        lcs[i][j] = a[i - 1] == b[j - 1] ? lcs[i - 1][j - 1] + 1 : std::max(lcs[i - 1][j], lcs[i][j - 1]);
+
+    std::string baseJson = JS::serializeStruct(a);
+    std::string diffJson = JS::serializeStruct(b);
+    JS::DiffContext diffContext(baseJson, options);
+    const JS::DiffTokens &diff = diffContext.diffs[diffContext.diff(diffJson)];
+    size_t inserted = 0;
+    for (size_t i = 1; i + 1 < diff.size(); i++)
+      inserted += diff.diffs[i] == JS::DiffType::NewArrayItem;
+    const std::vector<JS::Token> *missing = diff.getMissingArrayItems(diff.tokens.data[0]);
+    const size_t deleted = missing ? missing->size() : 0;
+    REQUIRE(b.size() - inserted == lcs[a.size()][b.size()]);
+    REQUIRE(a.size() - deleted == lcs[a.size()][b.size()]);
+  }
+}
+
+TEST_CASE("diff_check_aligned_array_all_changed", "[json_struct][diff]")
+{
+  const size_t count = 100000;
+  std::vector<int> a;
+  std::vector<int> b;
+  for (size_t i = 0; i < count; i++)
+  {
+    a.push_back(int(i));
+    b.push_back(int(i + count));
+  }
+  std::string baseJson = JS::serializeStruct(a);
+  std::string diffJson = JS::serializeStruct(b);
+  JS::DiffContext diffContext(baseJson, JS::DiffOptions(JS::DiffFlags::AlignArrays, 0));
+  const JS::DiffTokens &diff = diffContext.diffs[diffContext.diff(diffJson)];
+  // Too different to align, so every item is reported as a positional change
+  REQUIRE(diff.diff_count == count);
+  REQUIRE(diff.diffs[1] == JS::DiffType::ValueDiff);
+}
+
+TEST_CASE("diff_check_aligned_array_fuzzy_floats", "[json_struct][diff]")
+{
+  std::string baseJson = R"json([1.0, {"a": 2.0}, 3.0])json";
+  std::string diffJson = R"json([0, 1.0000001, {"a": 2.0000001}, 3.0])json";
+  JS::DiffContext fuzzyContext(baseJson, JS::DiffOptions(JS::DiffFlags::FuzzyFloatComparison | JS::DiffFlags::AlignArrays, 1e-6));
+  const JS::DiffTokens &fuzzy = fuzzyContext.diffs[fuzzyContext.diff(diffJson)];
+  REQUIRE(fuzzy.diff_count == 1);
+  REQUIRE(fuzzy.diffs[1] == JS::DiffType::NewArrayItem);
+
+  JS::DiffContext exactContext(baseJson, JS::DiffOptions(JS::DiffFlags::AlignArrays, 0));
+  const JS::DiffTokens &exact = exactContext.diffs[exactContext.diff(diffJson)];
+  REQUIRE(exact.diff_count > 1);
+}
+
+TEST_CASE("diff_check_array_items_matched_by_identity", "[json_struct][diff]")
+{
+  std::string baseJson = R"json([{"id": 1, "v": "a"}, {"id": 2, "v": "b"}, {"id": 3, "v": "c"}, {"id": 5}])json";
+  std::string diffJson = R"json([{"id": 3, "v": "c"}, {"v": "a", "id": 1}, {"id": 2, "v": "B"}, {"id": 4}])json";
+  JS::DiffOptions options;
+  options.arrayIdentityMember = "id";
+
+  JS::DiffContext diffContext(baseJson, options);
+  REQUIRE(diffContext.error == JS::DiffError::NoError);
+  size_t diffPos = diffContext.diff(diffJson);
+  REQUIRE(diffContext.error == JS::DiffError::NoError);
+  const JS::DiffTokens &diff = diffContext.diffs[diffPos];
+
+  REQUIRE(diff.diffs[0] == JS::DiffType::MissingArrayItems);
+  const std::vector<JS::Token> *missing = diff.getMissingArrayItems(diff.tokens.data[0]);
+  REQUIRE(missing);
+  REQUIRE(missing->size() == 3);
+  REQUIRE(std::string((*missing)[1].value.data, (*missing)[1].value.size) == "5");
+
+  for (size_t i = 1; i < 9; i++)
+    REQUIRE(diff.diffs[i] == JS::DiffType::NoDiff);
+  REQUIRE(diff.diffs[9] == JS::DiffType::NoDiff);
+  REQUIRE(diff.diffs[10] == JS::DiffType::NoDiff);
+  REQUIRE(diff.diffs[11] == JS::DiffType::ValueDiff);
+  REQUIRE(diff.diffs[13] == JS::DiffType::NewArrayItem);
+  REQUIRE(diff.diffs[14] == JS::DiffType::NewArrayItem);
+  REQUIRE(diff.diffs[15] == JS::DiffType::NewArrayItem);
+
+  REQUIRE(diff.movedArrayItems.size() == 1);
+  const std::vector<std::pair<size_t, size_t>> *moved = diff.getMovedArrayItems(0);
+  REQUIRE(moved);
+  REQUIRE(moved->size() == 1);
+  REQUIRE((*moved)[0].first == 1);
+  REQUIRE((*moved)[0].second == 2);
+  REQUIRE(!diff.getMovedArrayItems(1));
+
+  options.arrayIdentityMember = "name";
+  JS::DiffContext fallbackContext(baseJson, options);
+  diffPos = fallbackContext.diff(diffJson);
+  REQUIRE(fallbackContext.diffs[diffPos].movedArrayItems.empty());
+  REQUIRE(fallbackContext.diffs[diffPos].diffs[2] == JS::DiffType::ValueDiff);
+}
+
+TEST_CASE("diff_check_parallel_documents", "[json_struct][diff]")
+{
+  std::string baseJson(basicBaseJson);
+  std::vector<std::string> documents;
+  for (int i = 0; i < 64; i++)
+    documents.push_back(i % 3 ? std::string(basicDiffJsonEqual) : std::string(basicDiffJsonDifferent));
+  documents.push_back(std::string());
+
+  JS::DiffContext serial(baseJson);
+  JS::DiffContext parallel(baseJson);
+  parallel.threadCount = 4;
+  std::vector<size_t> positions = parallel.diff(documents);
+  REQUIRE(parallel.error == JS::DiffError::EmptyString);
+  REQUIRE(positions.size() == documents.size());
+  REQUIRE(positions.back() == size_t(-1));
+  REQUIRE(parallel.diffs.size() == documents.size() - 1);
+
+  for (size_t i = 0; i + 1 < documents.size(); i++)
+  {
+    size_t serialPos = serial.diff(documents[i]);
+    REQUIRE(positions[i] == i);
+    REQUIRE(parallel.diffs[positions[i]].diffs == serial.diffs[serialPos].diffs);
+    REQUIRE(parallel.diffs[positions[i]].diff_count == serial.diffs[serialPos].diff_count);
+  }
+
+  parallel.invalidate(JS::DiffOptions(JS::DiffFlags::None, 0.0));
+  serial.invalidate(JS::DiffOptions(JS::DiffFlags::None, 0.0));
+  for (size_t i = 0; i < serial.diffs.size(); i++)
+    REQUIRE(parallel.diffs[i].diffs == serial.diffs[i].diffs);
+}
+
+TEST_CASE("diff_check_parallel_exception", "[json_struct][diff]")
+{
+  std::atomic<size_t> calls(0);
+  bool caught = false;
+  try
+  {
+    JS::Internal::Diff::parallelFor(1000, 4, [&calls](size_t i) {
+      calls++;
+      if (i == 10)
+        throw std::runtime_error("diff failed");
+    });
+  }
+  catch (const std::runtime_error &e)
+  {
+    caught = true;
+    REQUIRE(std::string(e.what()) == "diff failed");
+  }
+  REQUIRE(caught);
+  REQUIRE(calls >= 11);
+}
+
+static void requirePatchRoundTrip(const std::string &baseJson, const std::string &diffJson, const JS::DiffOptions &options = {})
+{
+  JS::DiffContext diffContext(baseJson, options);
+  REQUIRE(diffContext.error == JS::DiffError::NoError);
+  size_t diffPos = diffContext.diff(diffJson);
+  REQUIRE(diffContext.error == JS::DiffError::NoError);
+  std::string patch = JS::createJsonPatch(diffContext.diffs[diffPos]);
+
+  std::string patched = baseJson;
+  REQUIRE(JS::applyJsonPatch(patched, patch) == JS::PatchError::NoError);
+
+  JS::DiffContext verifyContext(patched, JS::DiffOptions(JS::DiffFlags::None, 0.0));
+  size_t verifyPos = verifyContext.diff(diffJson);
+  REQUIRE(verifyContext.error == JS::DiffError::NoError);
+  REQUIRE(verifyContext.diffs[verifyPos].diff_count == 0);
+}
+
+TEST_CASE("diff_check_json_patch_round_trip", "[json_struct][diff][patch]")
+{
+  requirePatchRoundTrip(basicBaseJson, basicDiffJsonDifferent);
+  requirePatchRoundTrip(basicBaseJsonWithSubObject, basicDiffJsonDifferentWithSubObject);
+  requirePatchRoundTrip(basicArrayJson, basicArrayJsonDifferent);
+  requirePatchRoundTrip(largeObjectWithAllDataTypes, largeObjectWithAllDataTypesDifferent);
+  requirePatchRoundTrip(jsonWithSubObjects, jsonWithSubObjects_MissingAndNewMembers);
+  requirePatchRoundTrip(jsonMissingMembersAndArrayItemsBase, jsonMissingMembersAndArrayItemsDiff);
+  requirePatchRoundTrip(R"json({"a": [1, 2]})json", R"json({"a": [1, 3, 4, {"b": "/~"}]})json");
+  requirePatchRoundTrip(R"json([1, 2, 3])json", R"json({"a": 1})json");
+
+  JS::DiffOptions identityOptions;
+  identityOptions.arrayIdentityMember = "id";
+  requirePatchRoundTrip(R"json([{"id": 1, "v": 1}, {"id": 2}])json", R"json([{"id": 2}, {"id": 1, "v": 2}])json",
+                        identityOptions);
+}
+
+TEST_CASE("diff_check_json_patch_output", "[json_struct][diff][patch]")
+{
+  std::string baseJson = R"json({"a": 1, "b/c": [1], "d": true})json";
+  std::string diffJson = R"json({"a": 2, "b/c": [1, "x"], "e": null})json";
+  JS::DiffContext diffContext(baseJson);
+  size_t diffPos = diffContext.diff(diffJson);
+  std::string patch = JS::createJsonPatch(diffContext.diffs[diffPos]);
+  REQUIRE(patch == R"json([{"op":"replace","path":"/a","value":2},)json"
+                   R"json({"op":"add","path":"/b~1c/-","value":"x"},)json"
+                   R"json({"op":"add","path":"/e","value":null},)json"
+                   R"json({"op":"remove","path":"/d"}])json");
+}
+
+TEST_CASE("diff_check_json_patch_array_operations", "[json_struct][diff][patch]")
+{
+  std::string baseJson = "[";
+  for (int i = 0; i < 100; i++)
+    baseJson += (i ? "," : "") + std::to_string(i);
+  baseJson += "]";
+  std::string diffJson = baseJson;
+  diffJson.replace(diffJson.find(",50,"), 4, ",");
+
+  JS::DiffOptions alignOptions(JS::DiffFlags::AlignArrays, 0.0);
+  JS::DiffContext alignContext(baseJson, alignOptions);
+  size_t diffPos = alignContext.diff(diffJson);
+  REQUIRE(JS::createJsonPatch(alignContext.diffs[diffPos]) == R"json([{"op":"remove","path":"/50"}])json");
+  requirePatchRoundTrip(baseJson, diffJson, alignOptions);
+
+  JS::DiffOptions identityOptions;
+  identityOptions.arrayIdentityMember = "id";
+  std::string identityBase = R"json({"a": [{"id": 1, "text": "one item with some text"}, {"id": 2, "text": "two"},)json"
+                             R"json({"id": 3, "text": "three items with some text"}, {"id": 4, "text": "four items"},)json"
+                             R"json({"id": 5, "text": "five items with some text"}]})json";
+  std::string identityDiff = R"json({"a": [{"id": 3, "text": "three items with some text"},)json"
+                             R"json({"id": 1, "text": "one item with some text"}, {"id": 6},)json"
+                             R"json({"id": 4, "text": "four items"}, {"id": 2, "text": "two", "v": 1}]})json";
+  JS::DiffContext identityContext(identityBase, identityOptions);
+  diffPos = identityContext.diff(identityDiff);
+  REQUIRE(JS::createJsonPatch(identityContext.diffs[diffPos]) ==
+          R"json([{"op":"remove","path":"/a/4"},)json"
+          R"json({"op":"move","path":"/a/0","from":"/a/2"},)json"
+          R"json({"op":"move","path":"/a/2","from":"/a/3"},)json"
+          R"json({"op":"add","path":"/a/2","value":{"id": 6}},)json"
+          R"json({"op":"add","path":"/a/4/v","value":1}])json");
+  requirePatchRoundTrip(identityBase, identityDiff, identityOptions);
+
+  // Replacing is shorter when every item changes.
+  JS::DiffContext replaceContext(R"json({"a": [1, 2, 3]})json", alignOptions);
+  diffPos = replaceContext.diff(R"json({"a": [4, 5, 6]})json");
+  REQUIRE(JS::createJsonPatch(replaceContext.diffs[diffPos]) == R"json([{"op":"replace","path":"/a","value":[4, 5, 6]}])json");
+
+  // Reordering by identity, removing and adding items in many combinations.
+  const std::string text = R"json(,"text":"an item with enough text that moving it is cheaper than replacing it"})json";
+  std::vector<int> order = {1, 2, 3, 4, 5, 6};
+  uint32_t seed = 7;
+  int patchesWithMoves = 0;
+  for (int round = 0; round < 200; round++)
+  {
+    std::string base = "[";
+    for (size_t i = 0; i < order.size(); i++)
+      base += (i ? ",{\"id\":" : "{\"id\":") + std::to_string(order[i]) + text;
+    base += "]";
+    std::string next = "[";
+    std::vector<int> used;
+    for (int i = 0; i < 8; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      int id = int(seed >> 16) % 9;
+      if (std::find(used.begin(), used.end(), id) != used.end())
+        continue;
+      next += (used.empty() ? "{\"id\":" : ",{\"id\":") + std::to_string(id) + text;
+      used.push_back(id);
+    }
+    next += "]";
+    requirePatchRoundTrip(base, next, identityOptions);
+
+    JS::DiffContext context(base, identityOptions);
+    size_t pos = context.diff(next);
+    if (JS::createJsonPatch(context.diffs[pos]).find("\"move\"") != std::string::npos)
+      patchesWithMoves++;
+    std::next_permutation(order.begin(), order.end());
+  }
+  REQUIRE(patchesWithMoves > 100);
+}
+
+TEST_CASE("diff_check_json_patch_apply", "[json_struct][diff][patch]")
+{
+  std::string json = R"json({
+    "foo": ["bar", "baz"],
+    "obj": {"x": 1, "y": 2}
+})json";
+  std::string patch = R"json([
+    {"op": "add", "path": "/foo/1", "value": "qux"},
+    {"op": "remove", "path": "/foo/0"},
+    {"op": "copy", "from": "/obj/x", "path": "/obj/z"},
+    {"op": "move", "from": "/obj/y", "path": "/foo/-"},
+    {"op": "test", "path": "/foo", "value": ["qux","baz",2]},
+    {"op": "replace", "path": "/obj", "value": {"a": []}}
+])json";
+  REQUIRE(JS::applyJsonPatch(json, patch) == JS::PatchError::NoError);
+  REQUIRE(json == R"json({
+    "foo": ["qux","baz",2],
+    "obj": {"a": []}
+})json");
+
+  std::string failing = R"json([{"op": "test", "path": "/obj/a", "value": [1]}])json";
+  REQUIRE(JS::applyJsonPatch(json, failing) == JS::PatchError::TestFailed);
+  failing = R"json([{"op": "remove", "path": "/foo/3"}])json";
+  REQUIRE(JS::applyJsonPatch(json, failing) == JS::PatchError::PathNotFound);
+  failing = R"json([{"path": "/foo"}])json";
+  REQUIRE(JS::applyJsonPatch(json, failing) == JS::PatchError::InvalidPatch);
+}
+
+TEST_CASE("diff_check_json_patch_escaped_names", "[json_struct][diff][patch]")
+{
+  std::string baseJson = R"json({"caf\u00e9": 1, "q\"uote": [1], "a/b~": 2})json";
+  std::string diffJson = R"json({"caf\u00e9": 2, "q\"uote": [1, 2]})json";
+  JS::DiffContext diffContext(baseJson);
+  size_t diffPos = diffContext.diff(diffJson);
+  REQUIRE(JS::createJsonPatch(diffContext.diffs[diffPos]) ==
+          "[{\"op\":\"replace\",\"path\":\"/caf\xc3\xa9\",\"value\":2},"
+          R"json({"op":"add","path":"/q\"uote/-","value":2},)json"
+          R"json({"op":"remove","path":"/a~1b~0"}])json");
+  requirePatchRoundTrip(baseJson, diffJson);
+
+  // Pointers written by other tools hold the unescaped names.
+  std::string json = R"json({"caf\u00e9": 1, "m\"n": {"A": true}})json";
+  std::string patch = "[{\"op\": \"test\", \"path\": \"/m\\\"n/A\", \"value\": true},"
+                      "{\"op\": \"replace\", \"path\": \"/caf\xc3\xa9\", \"value\": 3},"
+                      "{\"op\": \"remove\", \"path\": \"/m\\u0022n\"},"
+                      "{\"op\": \"add\", \"path\": \"/new\\\"name\", \"value\": 4}]";
+  REQUIRE(JS::applyJsonPatch(json, patch) == JS::PatchError::NoError);
+  REQUIRE(json == R"json({"caf\u00e9": 3,"new\"name":4})json");
+
+  JS::DataRef value;
+  REQUIRE(JS::findJsonPointer(json.data(), json.size(), "/new\"name", 9, value) == JS::Error::NoError);
+  REQUIRE(std::string(value.data, value.size) == "4");
+}
+
+TEST_CASE("diff_check_json_patch_atomic", "[json_struct][diff][patch]")
+{
+  const std::string original = R"json({"a": {"b": [1, 2]}, "c": 3})json";
+  std::string json = original;
+  std::string patch = R"json([
+    {"op": "remove", "path": "/c"},
+    {"op": "add", "path": "/a/b/-", "value": 3},
+    {"op": "remove", "path": "/missing"}
+])json";
+  REQUIRE(JS::applyJsonPatch(json, patch) == JS::PatchError::PathNotFound);
+  REQUIRE(json == original);
+
+  patch = R"json([{"op": "move", "from": "/a", "path": "/a/b/0"}])json";
+  REQUIRE(JS::applyJsonPatch(json, patch) == JS::PatchError::InvalidPatch);
+  REQUIRE(json == original);
+
+  patch = R"json([{"op": "move", "from": "/a/b", "path": "/a/bb"}, {"op": "move", "from": "/c", "path": "/c"}])json";
+  REQUIRE(JS::applyJsonPatch(json, patch) == JS::PatchError::NoError);
+  REQUIRE(json == R"json({"a": {"bb":[1, 2]},"c":3})json");
+}
+
+TEST_CASE("diff_check_json_patch_test_values", "[json_struct][diff][patch]")
+{
+  std::string json = R"json({"n": 1.0, "s": "A/", "o": {"x": [1, {"y": null}], "z": true}})json";
+  std::string patch = R"json([
+    {"op": "test", "path": "/n", "value": 1},
+    {"op": "test", "path": "/s", "value": "A\/"},
+    {"op": "test", "path": "/o", "value": {"z": true, "x": [1e0, {"y": null}]}}
+])json";
+  REQUIRE(JS::applyJsonPatch(json, patch) == JS::PatchError::NoError);
+
+  patch = R"json([{"op": "test", "path": "/o", "value": {"z": true}}])json";
+  REQUIRE(JS::applyJsonPatch(json, patch) == JS::PatchError::TestFailed);
+  patch = R"json([{"op": "test", "path": "/o/x", "value": [1, {"y": null}, 2]}])json";
+  REQUIRE(JS::applyJsonPatch(json, patch) == JS::PatchError::TestFailed);
+  patch = R"json([{"op": "test", "path": "/n", "value": "1"}])json";
+  REQUIRE(JS::applyJsonPatch(json, patch) == JS::PatchError::TestFailed);
+}
+
+TEST_CASE("diff_check_json_patch_many_operations", "[json_struct][diff][patch]")
+{
+  // Every operation works on the offsets left behind by the previous splices.
+  std::string json = R"json({"list": [], "obj": {}})json";
+  std::string patch = "[";
+  std::string expectedList;
+  for (int i = 0; i < 50; i++)
+  {
+    patch += R"json({"op": "add", "path": "/list/0", "value": )json" + std::to_string(i) + "},";
+    patch += R"json({"op": "add", "path": "/obj/k)json" + std::to_string(i) + R"json(", "value": [)json" + std::to_string(i) + "]},";
+  }
+  for (int i = 0; i < 50; i += 2)
+    patch += R"json({"op": "remove", "path": "/obj/k)json" + std::to_string(i) + R"json("},)json";
+  patch += R"json({"op": "copy", "from": "/obj/k1", "path": "/list/-"},)json";
+  patch += R"json({"op": "move", "from": "/list/0", "path": "/obj/first"},)json";
+  patch += R"json({"op": "replace", "path": "/obj/k49", "value": "last"},)json";
+  patch += R"json({"op": "test", "path": "/list/48", "value": 0}])json";
+  REQUIRE(JS::applyJsonPatch(json, patch) == JS::PatchError::NoError);
+
+  std::string expected = R"json({"list": [)json";
+  for (int i = 48; i >= 0; i--)
+    expected += std::to_string(i) + ",";
+  expected += R"json([1]], "obj": {)json";
+  for (int i = 1; i < 49; i += 2)
+    expected += R"json("k)json" + std::to_string(i) + R"json(":[)json" + std::to_string(i) + "],";
+  expected += R"json("k49":"last","first":49}})json";
+  REQUIRE(json == expected);
+}
+
 } // namespace
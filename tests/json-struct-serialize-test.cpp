@@ -210,4 +210,95 @@ TEST_CASE("test_serialize_empty_string", "[json_struct][serialize]")
   REQUIRE(out == empty_string_json);
 }
 
+struct MemoizedReference
+{
+  std::string name;
+  std::vector<int> values;
+  JS_OBJ(name, values);
+};
+
+struct MemoizedResponse
+{
+  int id;
+  JS::Memoized<MemoizedReference> reference;
+  JS_OBJ(id, reference);
+};
+
+TEST_CASE("test_serialize_memoized", "[json_struct][serialize]")
+{
+  MemoizedReference reference;
+  reference.name = "shared";
+  reference.values = {1, 2, 3};
+  JS::Memoized<MemoizedReference> memoized(reference);
+
+  MemoizedResponse first;
+  first.id = 1;
+  first.reference = memoized;
+  MemoizedResponse second;
+  second.id = 2;
+  second.reference = memoized;
+  REQUIRE(first.reference.state == second.reference.state);
+  REQUIRE(memoized.state->json.load() == nullptr);
+
+  JS::SerializerOptions compact(JS::SerializerOptions::Compact);
+  std::string out1 = JS::serializeStruct(first, compact);
+  REQUIRE(out1 == R"json({"id":1,"reference":{"name":"shared","values":[1,2,3]}})json");
+  const std::string *cached = memoized.state->json.load();
+  REQUIRE(cached != nullptr);
+
+  std::string out2 = JS::serializeStruct(second, compact);
+  REQUIRE(out2 == R"json({"id":2,"reference":{"name":"shared","values":[1,2,3]}})json");
+  REQUIRE(memoized.state->json.load() == cached);
+
+  MemoizedResponse parsed;
+  JS::ParseContext context(out2);
+  REQUIRE(context.parseTo(parsed) == JS::Error::NoError);
+  REQUIRE(parsed.id == 2);
+  REQUIRE(parsed.reference().name == "shared");
+  REQUIRE(parsed.reference().values == reference.values);
+}
+
+struct PlainResponse
+{
+  int id;
+  MemoizedReference reference;
+  JS_OBJ(id, reference);
+};
+
+TEST_CASE("test_serialize_memoized_pretty", "[json_struct][serialize]")
+{
+  PlainResponse plain;
+  plain.id = 1;
+  plain.reference.name = "shared";
+  plain.reference.values = {1, 2, 3};
+  MemoizedResponse memoized;
+  memoized.id = 1;
+  memoized.reference = plain.reference;
+
+  std::string pretty = JS::serializeStruct(memoized);
+  REQUIRE(pretty == JS::serializeStruct(plain));
+  REQUIRE(memoized.reference.state->json.load() == nullptr);
+  REQUIRE(memoized.reference.state->pretty_json.load() != nullptr);
+
+  std::vector<MemoizedResponse> nested(1, memoized);
+  std::vector<PlainResponse> nested_plain(1, plain);
+  REQUIRE(JS::serializeStruct(nested) == JS::serializeStruct(nested_plain));
+
+  JS::SerializerOptions compact(JS::SerializerOptions::Compact);
+  REQUIRE(JS::serializeStruct(memoized, compact) == JS::serializeStruct(plain, compact));
+}
+
+TEST_CASE("test_parse_memoized_error_keeps_state", "[json_struct][serialize]")
+{
+  MemoizedResponse response;
+  JS::ParseContext context(R"json({"id":1,"reference":{"name":"shared","values":[1,2,3]}})json");
+  REQUIRE(context.parseTo(response) == JS::Error::NoError);
+  auto state = response.reference.state;
+
+  JS::ParseContext broken(R"json({"id":2,"reference":{"name":"other","values":[4,"x"]}})json");
+  REQUIRE(broken.parseTo(response) != JS::Error::NoError);
+  REQUIRE(response.reference.state == state);
+  REQUIRE(response.reference().name == "shared");
+}
+
 } // namespace
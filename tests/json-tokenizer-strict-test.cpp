@@ -0,0 +1,100 @@
+#include "json-test-data.h"
+#include "json_struct.h"
+
+#include "catch2/catch.hpp"
+
+namespace
+{
+template <typename Tokenizer>
+static JS::Error tokenize(Tokenizer &tokenizer, std::vector<JS::Token> &tokens)
+{
+  JS::Token token;
+  JS::Error error = JS::Error::NoError;
+  while (error == JS::Error::NoError)
+  {
+    error = tokenizer.nextToken(token);
+    if (error == JS::Error::NoError)
+      tokens.push_back(token);
+  }
+  return error;
+}
+
+TEST_CASE("strict_tokenizer_same_tokens_as_tokenizer", "[tokenizer][strict]")
+{
+  JS::Tokenizer lenient;
+  lenient.addData(json_data2);
+  std::vector<JS::Token> lenient_tokens;
+  REQUIRE(tokenize(lenient, lenient_tokens) == JS::Error::NeedMoreData);
+
+  JS::StrictTokenizer strict;
+  strict.addData(json_data2);
+  std::vector<JS::Token> strict_tokens;
+  REQUIRE(tokenize(strict, strict_tokens) == JS::Error::NeedMoreData);
+
+  REQUIRE(lenient_tokens.size() == strict_tokens.size());
+  for (size_t i = 0; i < lenient_tokens.size(); i++)
+  {
+    REQUIRE(lenient_tokens[i].name_type == strict_tokens[i].name_type);
+    REQUIRE(lenient_tokens[i].value_type == strict_tokens[i].value_type);
+    REQUIRE(std::string(lenient_tokens[i].name.data, lenient_tokens[i].name.size) ==
+            std::string(strict_tokens[i].name.data, strict_tokens[i].name.size));
+    REQUIRE(std::string(lenient_tokens[i].value.data, lenient_tokens[i].value.size) ==
+            std::string(strict_tokens[i].value.data, strict_tokens[i].value.size));
+  }
+}
+
+const char strict_ascii_property[] = R"json({ "foo" : "bar", color : "red" })json";
+const char strict_ascii_data[] = R"json({ "foo" : "bar", "color" : red })json";
+const char strict_superfluous_comma[] = R"json({ "foo" : "bar", "color" : "red", })json";
+const char strict_new_line_delimiter[] = "{ \"foo\" : \"bar\"\n \"color\" : \"red\" }";
+
+TEST_CASE("strict_tokenizer_rejects_lenient_json", "[tokenizer][strict]")
+{
+  std::vector<JS::Token> tokens;
+  JS::StrictTokenizer ascii_property;
+  ascii_property.addData(strict_ascii_property);
+  REQUIRE(tokenize(ascii_property, tokens) == JS::Error::IllegalPropertyName);
+
+  tokens.clear();
+  JS::StrictTokenizer ascii_data;
+  ascii_data.addData(strict_ascii_data);
+  REQUIRE(tokenize(ascii_data, tokens) == JS::Error::IllegalDataValue);
+
+  tokens.clear();
+  JS::StrictTokenizer superfluous_comma;
+  superfluous_comma.addData(strict_superfluous_comma);
+  REQUIRE(tokenize(superfluous_comma, tokens) == JS::Error::ExpectedDataToken);
+
+  tokens.clear();
+  JS::StrictTokenizer new_line_delimiter;
+  new_line_delimiter.addData(strict_new_line_delimiter);
+  REQUIRE(tokenize(new_line_delimiter, tokens) == JS::Error::InvalidToken);
+}
+
+TEST_CASE("strict_tokenizer_partial_data", "[tokenizer][strict]")
+{
+  const char first[] = R"json({ "foo" : "ba)json";
+  const char second[] = R"json(r", "number" : 12)json";
+  const char third[] = R"json(34 })json";
+
+  JS::StrictTokenizer tokenizer;
+  tokenizer.addData(first, sizeof(first) - 1);
+  tokenizer.addData(second, sizeof(second) - 1);
+  tokenizer.addData(third, sizeof(third) - 1);
+
+  std::vector<std::string> values;
+  JS::Token token;
+  JS::Error error = JS::Error::NoError;
+  while (error == JS::Error::NoError)
+  {
+    error = tokenizer.nextToken(token);
+    if (error == JS::Error::NoError)
+      values.emplace_back(token.value.data, token.value.size);
+  }
+  REQUIRE(error == JS::Error::NeedMoreData);
+  REQUIRE(values.size() == 4);
+  REQUIRE(values[1] == "bar");
+  REQUIRE(values[2] == "1234");
+  REQUIRE(values[3] == "}");
+}
+} // namespace
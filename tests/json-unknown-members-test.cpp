@@ -0,0 +1,88 @@
+#include "json_struct.h"
+
+#include "catch2/catch.hpp"
+
+namespace
+{
+struct Known
+{
+  int id;
+  std::string name;
+  JS::UnknownMembers unknown;
+  JS_OBJ(id, name, unknown);
+};
+
+struct Outer
+{
+  Known inner;
+  JS::UnknownMembers rest;
+  JS_OBJ(inner, rest);
+};
+
+struct NoUnknown
+{
+  int id;
+  JS_OBJ(id);
+};
+
+using KnownMembers = decltype(JS::Internal::JsonStructBaseDummy<Known, Known>::js_static_meta_data_info());
+using OuterMembers = decltype(JS::Internal::JsonStructBaseDummy<Outer, Outer>::js_static_meta_data_info());
+using NoUnknownMembers = decltype(JS::Internal::JsonStructBaseDummy<NoUnknown, NoUnknown>::js_static_meta_data_info());
+static_assert(JS::Internal::UnknownMembersIndex<KnownMembers, 0>::value == 2, "UnknownMembers found at compile time");
+static_assert(JS::Internal::UnknownMembersIndex<OuterMembers, 0>::value == 1, "UnknownMembers found at compile time");
+static_assert(JS::Internal::UnknownMembersIndex<NoUnknownMembers, 0>::value == NoUnknownMembers::size,
+              "structs without UnknownMembers have no lookup");
+
+const char json_with_unknown[] =
+  R"json({"id":1,"extra":{"nested":[1,{"a":null}]},"name":"x","flag":true,"text":"a \"quoted\" value","unknown":2.5})json";
+
+TEST_CASE("unknown_members_are_collected", "[json_struct][unknown_members]")
+{
+  Known known;
+  JS::ParseContext context(json_with_unknown);
+  REQUIRE(context.parseTo(known) == JS::Error::NoError);
+  REQUIRE(known.id == 1);
+  REQUIRE(known.name == "x");
+  REQUIRE(known.unknown.size() == 4);
+  REQUIRE(std::string(known.unknown.name(0).data, known.unknown.name(0).size) == "extra");
+  REQUIRE(std::string(known.unknown.value(0).data, known.unknown.value(0).size) == R"json({"nested":[1,{"a":null}]})json");
+  REQUIRE(std::string(known.unknown.name(3).data, known.unknown.name(3).size) == "unknown");
+
+  JS::ParseContext context2(R"json({"id":2,"name":"y"})json");
+  REQUIRE(context2.parseTo(known) == JS::Error::NoError);
+  REQUIRE(known.unknown.empty());
+}
+
+TEST_CASE("unknown_members_round_trip", "[json_struct][unknown_members]")
+{
+  Known known;
+  JS::ParseContext context(json_with_unknown);
+  REQUIRE(context.parseTo(known) == JS::Error::NoError);
+
+  std::string out = JS::serializeStruct(known, JS::SerializerOptions(JS::SerializerOptions::Compact));
+  REQUIRE(out ==
+          R"json({"id":1,"name":"x","extra":{"nested":[1,{"a":null}]},"flag":true,"text":"a \"quoted\" value","unknown":2.5})json");
+}
+
+TEST_CASE("unknown_members_nested", "[json_struct][unknown_members]")
+{
+  const char json[] = R"json({"inner":{"id":3,"name":"z","more":[]},"other":"value"})json";
+  Outer outer;
+  JS::ParseContext context(json);
+  REQUIRE(context.parseTo(outer) == JS::Error::NoError);
+  REQUIRE(outer.inner.unknown.size() == 1);
+  REQUIRE(outer.rest.size() == 1);
+
+  std::string out = JS::serializeStruct(outer, JS::SerializerOptions(JS::SerializerOptions::Compact));
+  REQUIRE(out == json);
+}
+
+TEST_CASE("unknown_members_absent", "[json_struct][unknown_members]")
+{
+  NoUnknown value;
+  JS::ParseContext context(R"json({"id":1,"extra":2})json");
+  REQUIRE(context.parseTo(value) == JS::Error::NoError);
+  REQUIRE(value.id == 1);
+  REQUIRE(context.missing_members.size() == 1);
+}
+} // namespace
@@ -0,0 +1,139 @@
+#include "json_struct.h"
+
+#include "catch2/catch.hpp"
+
+namespace
+{
+const char value_json[] = R"json({
+  "name" : "a string that does not fit inline",
+  "short" : "tab\tin",
+  "count" : 42,
+  "ratio" : -0.25,
+  "flags" : [true, false, null ],
+  "nested" : { "list" : [ { "id" : 1 }, { "id" : 2 } ], "empty" : {} }
+})json";
+
+struct WithValue
+{
+  int id;
+  JS::Value payload;
+  JS_OBJ(id, payload);
+};
+
+TEST_CASE("value_node_size", "[json_struct][value]")
+{
+  STATIC_REQUIRE(sizeof(JS::Internal::ValueNode) == 16);
+}
+
+TEST_CASE("value_parse", "[json_struct][value]")
+{
+  JS::Value value;
+  JS::ParseContext context(value_json);
+  REQUIRE(context.parseTo(value) == JS::Error::NoError);
+
+  REQUIRE(value.isObject());
+  REQUIRE(value.size() == 6);
+  REQUIRE(std::string(value.name(0).data, value.name(0).size) == "name");
+  REQUIRE(value["name"].toString() == "a string that does not fit inline");
+  REQUIRE(value["short"].toString() == "tab\tin");
+  REQUIRE(value["count"].isInteger());
+  REQUIRE(value["count"].toInt() == 42);
+  REQUIRE(value["ratio"].isNumber());
+  REQUIRE(!value["ratio"].isInteger());
+  REQUIRE(value["ratio"].toDouble() == -0.25);
+
+  JS::ValueRef flags = value["flags"];
+  REQUIRE(flags.isArray());
+  REQUIRE(flags.size() == 3);
+  REQUIRE(flags[0].toBool());
+  REQUIRE(flags[1].isBool());
+  REQUIRE(!flags[1].toBool());
+  REQUIRE(flags[2].isNull());
+  REQUIRE(!flags[3].isValid());
+
+  JS::ValueRef list = value["nested"]["list"];
+  REQUIRE(list.size() == 2);
+  REQUIRE(list[1]["id"].toInt() == 2);
+  REQUIRE(value["nested"]["empty"].isObject());
+  REQUIRE(value["nested"]["empty"].size() == 0);
+  REQUIRE(!value["missing"].isValid());
+}
+
+TEST_CASE("value_round_trip", "[json_struct][value]")
+{
+  JS::Value value;
+  JS::ParseContext context(value_json);
+  REQUIRE(context.parseTo(value) == JS::Error::NoError);
+
+  std::string out = JS::serializeStruct(value, JS::SerializerOptions(JS::SerializerOptions::Compact));
+  REQUIRE(out == R"json({"name":"a string that does not fit inline","short":"tab\tin","count":42,"ratio":-0.25,)json"
+                 R"json("flags":[true,false,null],"nested":{"list":[{"id":1},{"id":2}],"empty":{}}})json");
+
+  JS::Value copy = value;
+  value.clear();
+  REQUIRE(value.isNull());
+  REQUIRE(copy["nested"]["list"][0]["id"].toInt() == 1);
+  REQUIRE(JS::serializeStruct(copy, JS::SerializerOptions(JS::SerializerOptions::Compact)) == out);
+}
+
+TEST_CASE("value_modify", "[json_struct][value]")
+{
+  JS::Value value;
+  value.insert("id").setInt(7);
+  JS::ValueRef items = value.insert("items");
+  for (int i = 0; i < 10; i++)
+    items.append().setDouble(i + 0.5);
+  value.insert("label").setString("quote \" and a long tail");
+  value.insert("id").setBool(true);
+  REQUIRE(value.size() == 3);
+  REQUIRE(value["items"].size() == 10);
+  REQUIRE(value["items"][9].toDouble() == 9.5);
+  REQUIRE(!value["id"].append().isValid());
+
+  std::string out = JS::serializeStruct(value, JS::SerializerOptions(JS::SerializerOptions::Compact));
+  REQUIRE(out == R"json({"id":true,"items":[0.5,1.5,2.5,3.5,4.5,5.5,6.5,7.5,8.5,9.5],"label":"quote \" and a long tail"})json");
+}
+
+TEST_CASE("value_struct_member", "[json_struct][value]")
+{
+  const char json[] = R"json({ "id" : 3, "payload" : [ 1, "two", { "three" : 3.5 } ] })json";
+  WithValue with_value;
+  JS::ParseContext context(json);
+  REQUIRE(context.parseTo(with_value) == JS::Error::NoError);
+  REQUIRE(with_value.id == 3);
+  REQUIRE(with_value.payload.size() == 3);
+  REQUIRE(with_value.payload[1].toString() == "two");
+  REQUIRE(with_value.payload[2]["three"].toDouble() == 3.5);
+
+  WithValue copy = with_value;
+  std::string out = JS::serializeStruct(copy, JS::SerializerOptions(JS::SerializerOptions::Compact));
+  REQUIRE(out == R"json({"id":3,"payload":[1,"two",{"three":3.5}]})json");
+}
+
+TEST_CASE("value_shared_arena", "[json_struct][value]")
+{
+  JS::Value kept;
+  {
+    std::vector<JS::Value> values;
+    JS::ParseContext context(R"json([ { "name" : "a long enough string" }, [ 1, 2, 3 ], "short", null ])json");
+    REQUIRE(context.parseTo(values) == JS::Error::NoError);
+    REQUIRE(values.size() == 4);
+    REQUIRE(context.value_arena);
+    REQUIRE(context.value_arena.use_count() == 5);
+
+    values[1].append().setString("appended to a shared arena");
+    values[3].setString("another string that needs the arena");
+    kept = values[1];
+    values[0].clear();
+    REQUIRE(values[0].isNull());
+    REQUIRE(values[2].toString() == "short");
+  }
+  REQUIRE(kept.size() == 4);
+  REQUIRE(kept[3].toString() == "appended to a shared arena");
+
+  JS::ValueRef invalid;
+  REQUIRE(invalid.type() == JS::Type::Error);
+  REQUIRE(kept[10].type() == JS::Type::Error);
+}
+
+} // namespace
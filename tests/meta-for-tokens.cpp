@@ -48,4 +48,33 @@ TEST_CASE("testMetaForTokens", "[meta]")
   REQUIRE((1 + metaInfo.at(1).skip + metaInfo.at(1 + metaInfo.at(1).skip).skip) == 7);
 }
 
+TEST_CASE("testMetaForTokensDeeplyNested", "[meta]")
+{
+  const size_t depth = 1000;
+  std::string json;
+  for (size_t i = 0; i < depth; i++)
+    json += i % 2 ? "{\"child\":" : "[";
+  json += "true";
+  for (size_t i = depth; i > 0; i--)
+    json += (i - 1) % 2 ? "}" : "]";
+
+  JS::ParseContext context(json.data(), json.size());
+  JS::JsonTokens tokens;
+  context.parseTo(tokens);
+  REQUIRE(context.error == JS::Error::NoError);
+  REQUIRE(tokens.data.size() == depth * 2 + 1);
+
+  std::vector<JS::JsonMeta> metaInfo = JS::metaForTokens(tokens);
+  REQUIRE(metaInfo.size() == depth);
+  for (size_t i = 0; i < depth; i++)
+  {
+    REQUIRE(metaInfo[i].position == i);
+    REQUIRE(metaInfo[i].is_array == (i % 2 == 0));
+    REQUIRE(metaInfo[i].size == (depth - i) * 2 + 1);
+    REQUIRE(metaInfo[i].skip == depth - i);
+    REQUIRE(metaInfo[i].children == 1);
+    REQUIRE(metaInfo[i].complex_children == (i + 1 < depth ? 1u : 0u));
+    REQUIRE(metaInfo[i].has_data);
+  }
+}
 } // namespace